@@ -0,0 +1,61 @@
+#include <benchmark/benchmark.h>
+
+#include <arcana/containers/sorted_vector.h>
+
+#include <random>
+#include <vector>
+
+namespace
+{
+    std::vector<int> random_values(size_t count)
+    {
+        std::mt19937 engine{ 42 };
+        std::uniform_int_distribution<int> distribution;
+
+        std::vector<int> values(count);
+        for (auto& value : values)
+        {
+            value = distribution(engine);
+        }
+        return values;
+    }
+
+    void SortedVectorInsert(benchmark::State& state)
+    {
+        const auto values = random_values(static_cast<size_t>(state.range(0)));
+
+        for (auto _ : state)
+        {
+            arcana::sorted_vector<int> sorted;
+            sorted.reserve(values.size());
+
+            for (int value : values)
+            {
+                sorted.insert(value);
+            }
+
+            benchmark::DoNotOptimize(sorted);
+        }
+
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(SortedVectorInsert)->Arg(64)->Arg(4096);
+
+    void SortedVectorFind(benchmark::State& state)
+    {
+        const auto values = random_values(static_cast<size_t>(state.range(0)));
+        const arcana::sorted_vector<int> sorted{ values.begin(), values.end() };
+
+        size_t index = 0;
+        for (auto _ : state)
+        {
+            auto found = sorted.find(values[index]);
+            benchmark::DoNotOptimize(found);
+
+            index = (index + 1) % values.size();
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(SortedVectorFind)->Arg(64)->Arg(4096);
+}
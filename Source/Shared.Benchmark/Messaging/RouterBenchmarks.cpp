@@ -0,0 +1,208 @@
+#include <benchmark/benchmark.h>
+
+#include <arcana/messaging/concurrent_router.h>
+#include <arcana/messaging/router.h>
+
+#include <atomic>
+
+#include <optional>
+#include <vector>
+
+namespace
+{
+    struct event
+    {
+        int value;
+    };
+
+    void RouterFire(benchmark::State& state)
+    {
+        arcana::router<event> router;
+        int64_t sum = 0;
+
+        std::vector<arcana::ticket> tickets;
+        for (int64_t i = 0; i < state.range(0); ++i)
+        {
+            tickets.push_back(router.add_listener<event>([&sum](const event& evt) { sum += evt.value; }));
+        }
+
+        for (auto _ : state)
+        {
+            router.fire(event{ 1 });
+        }
+
+        benchmark::DoNotOptimize(sum);
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(RouterFire)->Arg(1)->Arg(16)->Arg(256);
+
+    // a block of events fired one by one to a listener, compare with RouterFireBatch
+    void RouterFireEach(benchmark::State& state)
+    {
+        arcana::router<event> router;
+        int64_t sum = 0;
+
+        auto ticket = router.add_listener<event>([&sum](const event& evt) { sum += evt.value; });
+        std::vector<event> events(static_cast<size_t>(state.range(0)), event{ 1 });
+
+        for (auto _ : state)
+        {
+            for (const event& evt : events)
+            {
+                router.fire(evt);
+            }
+        }
+
+        benchmark::DoNotOptimize(sum);
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(RouterFireEach)->Arg(256);
+
+    void RouterFireBatch(benchmark::State& state)
+    {
+        arcana::router<event> router;
+        int64_t sum = 0;
+
+        auto ticket = router.add_batch_listener<event>([&sum](gsl::span<const event> events) {
+            for (const event& evt : events)
+            {
+                sum += evt.value;
+            }
+        });
+        std::vector<event> events(static_cast<size_t>(state.range(0)), event{ 1 });
+
+        for (auto _ : state)
+        {
+            router.fire_batch<event>(events);
+        }
+
+        benchmark::DoNotOptimize(sum);
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    BENCHMARK(RouterFireBatch)->Arg(256);
+
+    struct entity_event
+    {
+        size_t entity;
+        int value;
+    };
+
+    // one listener per entity filtering out the events of other entities, compare with RouterFireKeyed
+    void RouterFireFiltered(benchmark::State& state)
+    {
+        arcana::router<entity_event> router;
+        int64_t sum = 0;
+
+        std::vector<arcana::ticket> tickets;
+        for (size_t entity = 0; entity < static_cast<size_t>(state.range(0)); ++entity)
+        {
+            tickets.push_back(router.add_listener<entity_event>([&sum, entity](const entity_event& evt) {
+                if (evt.entity == entity)
+                {
+                    sum += evt.value;
+                }
+            }));
+        }
+
+        size_t entity = 0;
+        for (auto _ : state)
+        {
+            router.fire(entity_event{ entity, 1 });
+            entity = (entity + 1) % tickets.size();
+        }
+
+        benchmark::DoNotOptimize(sum);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(RouterFireFiltered)->Arg(10000);
+
+    void RouterFireKeyed(benchmark::State& state)
+    {
+        arcana::router<entity_event> router;
+        int64_t sum = 0;
+
+        std::vector<arcana::ticket> tickets;
+        for (size_t entity = 0; entity < static_cast<size_t>(state.range(0)); ++entity)
+        {
+            tickets.push_back(router.add_listener<entity_event>(entity, [&sum](const entity_event& evt) { sum += evt.value; }));
+        }
+
+        size_t entity = 0;
+        for (auto _ : state)
+        {
+            router.fire(entity, entity_event{ entity, 1 });
+            entity = (entity + 1) % tickets.size();
+        }
+
+        benchmark::DoNotOptimize(sum);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(RouterFireKeyed)->Arg(10000);
+
+    // every thread fires through the same router, listeners are registered once for all the runs
+    void ConcurrentRouterFire(benchmark::State& state)
+    {
+        static arcana::concurrent_router<event> router;
+        static std::atomic<int64_t> sum{ 0 };
+        static std::vector<arcana::ticket> tickets;
+
+        if (state.thread_index() == 0 && tickets.empty())
+        {
+            for (int i = 0; i < 16; ++i)
+            {
+                tickets.push_back(router.add_listener<event>([](const event& evt) { sum.fetch_add(evt.value, std::memory_order_relaxed); }));
+            }
+        }
+
+        for (auto _ : state)
+        {
+            router.fire(event{ 1 });
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(ConcurrentRouterFire)->Threads(1)->Threads(4)->UseRealTime();
+
+    void RouterListenerChurn(benchmark::State& state)
+    {
+        arcana::router<event> router;
+
+        std::vector<arcana::ticket> tickets;
+        for (int64_t i = 0; i < state.range(0); ++i)
+        {
+            tickets.push_back(router.add_listener<event>([](const event&) {}));
+        }
+
+        for (auto _ : state)
+        {
+            auto ticket = router.add_listener<event>([](const event&) {});
+            benchmark::DoNotOptimize(ticket);
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(RouterListenerChurn)->Arg(0)->Arg(256)->Arg(4096);
+
+    // replaces the oldest listener on every iteration, removing from the front of the list
+    void RouterListenerReplaceOldest(benchmark::State& state)
+    {
+        arcana::router<event> router;
+
+        std::vector<std::optional<arcana::ticket>> tickets(static_cast<size_t>(state.range(0)));
+        for (auto& ticket : tickets)
+        {
+            ticket.emplace(router.add_listener<event>([](const event&) {}));
+        }
+
+        size_t oldest = 0;
+        for (auto _ : state)
+        {
+            tickets[oldest].reset();
+            tickets[oldest].emplace(router.add_listener<event>([](const event&) {}));
+            oldest = (oldest + 1) % tickets.size();
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(RouterListenerReplaceOldest)->Arg(16)->Arg(256)->Arg(4096);
+}
@@ -0,0 +1,73 @@
+#include <benchmark/benchmark.h>
+
+#include <arcana/threading/cancellation.h>
+
+#include <vector>
+
+namespace
+{
+    void CancellationListenerChurn(benchmark::State& state)
+    {
+        arcana::cancellation_source source;
+        int64_t fired = 0;
+
+        for (auto _ : state)
+        {
+            auto ticket = source.add_listener([&fired] { ++fired; });
+            benchmark::DoNotOptimize(ticket);
+        }
+
+        benchmark::DoNotOptimize(fired);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(CancellationListenerChurn);
+
+    // adding and removing a listener while many others stay registered
+    void CancellationListenerChurnWithListeners(benchmark::State& state)
+    {
+        arcana::cancellation_source source;
+
+        std::vector<arcana::cancellation::ticket> registered;
+        for (int64_t i = 0; i < state.range(0); ++i)
+        {
+            registered.push_back(source.add_listener([] {}));
+        }
+
+        for (auto _ : state)
+        {
+            auto ticket = source.add_listener([] {});
+            benchmark::DoNotOptimize(ticket);
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(CancellationListenerChurnWithListeners)->Arg(16)->Arg(1024);
+
+    void CancelWithListeners(benchmark::State& state)
+    {
+        const auto count = state.range(0);
+        int64_t fired = 0;
+
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            arcana::cancellation_source source;
+            std::vector<arcana::cancellation::ticket> registered;
+            for (int64_t i = 0; i < count; ++i)
+            {
+                registered.push_back(source.add_listener([&fired] { ++fired; }));
+            }
+            state.ResumeTiming();
+
+            source.cancel();
+
+            state.PauseTiming();
+            registered.clear();
+            state.ResumeTiming();
+        }
+
+        benchmark::DoNotOptimize(fired);
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+    BENCHMARK(CancelWithListeners)->Arg(1)->Arg(64);
+}
@@ -0,0 +1,118 @@
+#include <benchmark/benchmark.h>
+
+#include <arcana/threading/blocking_concurrent_queue.h>
+#include <arcana/threading/dispatcher.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    void ManualDispatcherThroughput(benchmark::State& state)
+    {
+        const auto batch = state.range(0);
+
+        arcana::manual_dispatcher<32> dispatcher;
+        int64_t counter = 0;
+
+        for (auto _ : state)
+        {
+            for (int64_t i = 0; i < batch; ++i)
+            {
+                dispatcher.queue([&counter] { ++counter; });
+            }
+
+            dispatcher.tick(arcana::cancellation::none());
+        }
+
+        benchmark::DoNotOptimize(counter);
+        state.SetItemsProcessed(state.iterations() * batch);
+    }
+    BENCHMARK(ManualDispatcherThroughput)->Arg(1)->Arg(64)->Arg(1024);
+
+    void ManualDispatcherThroughputWithMetrics(benchmark::State& state)
+    {
+        const auto batch = state.range(0);
+
+        arcana::manual_dispatcher<32, arcana::park_wait_policy, arcana::dispatcher_metrics> dispatcher;
+        int64_t counter = 0;
+
+        for (auto _ : state)
+        {
+            for (int64_t i = 0; i < batch; ++i)
+            {
+                dispatcher.queue([&counter] { ++counter; });
+            }
+
+            dispatcher.tick(arcana::cancellation::none());
+        }
+
+        benchmark::DoNotOptimize(counter);
+        state.SetItemsProcessed(state.iterations() * batch);
+    }
+    BENCHMARK(ManualDispatcherThroughputWithMetrics)->Arg(1)->Arg(64)->Arg(1024);
+
+    // every benchmark thread pushes into the same queue, a single consumer drains it
+    arcana::blocking_concurrent_queue<int> s_contendedQueue;
+
+    void BlockingQueueContention(benchmark::State& state)
+    {
+        std::atomic<bool> draining{ true };
+        std::thread consumer;
+
+        if (state.thread_index() == 0)
+        {
+            consumer = std::thread{ [&draining] {
+                std::vector<int> drained;
+                while (draining.load(std::memory_order_relaxed))
+                {
+                    s_contendedQueue.try_drain(drained, arcana::cancellation::none());
+                    drained.clear();
+                }
+            } };
+        }
+
+        for (auto _ : state)
+        {
+            s_contendedQueue.push(1);
+        }
+
+        if (state.thread_index() == 0)
+        {
+            draining = false;
+            consumer.join();
+            s_contendedQueue.clear();
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BlockingQueueContention)->ThreadRange(1, 8)->UseRealTime();
+
+    //
+    // Round trips between the benchmark thread and a background dispatcher,
+    // comparing parking the dispatcher thread against spinning before parking.
+    //
+    template<typename WaitPolicy>
+    void BackgroundDispatcherPingPong(benchmark::State& state)
+    {
+        arcana::background_dispatcher<32, WaitPolicy> dispatcher;
+        std::atomic<int64_t> done{ 0 };
+
+        int64_t sent = 0;
+        for (auto _ : state)
+        {
+            ++sent;
+            dispatcher.queue([&done] { done.fetch_add(1, std::memory_order_release); });
+
+            while (done.load(std::memory_order_acquire) != sent)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK_TEMPLATE(BackgroundDispatcherPingPong, arcana::park_wait_policy)->UseRealTime();
+    BENCHMARK_TEMPLATE(BackgroundDispatcherPingPong, arcana::spin_then_park_wait_policy<>)->UseRealTime();
+}
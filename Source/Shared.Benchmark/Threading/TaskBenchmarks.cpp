@@ -0,0 +1,111 @@
+#include <benchmark/benchmark.h>
+
+#include <arcana/threading/dispatcher.h>
+#include <arcana/threading/task.h>
+
+#include <vector>
+
+namespace
+{
+    void TaskFromResult(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            auto task = arcana::task_from_result<std::error_code>(42);
+            benchmark::DoNotOptimize(task);
+        }
+    }
+    BENCHMARK(TaskFromResult);
+
+    void TaskCompletionSource(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            arcana::task_completion_source<int, std::error_code> source;
+            auto task = source.as_task();
+            source.complete(42);
+            benchmark::DoNotOptimize(task);
+        }
+    }
+    BENCHMARK(TaskCompletionSource);
+
+    void MakeTaskOnManualDispatcher(benchmark::State& state)
+    {
+        arcana::manual_dispatcher<32> dispatcher;
+
+        for (auto _ : state)
+        {
+            auto task = arcana::make_task(dispatcher, arcana::cancellation::none(), []() noexcept { return 42; });
+            dispatcher.tick(arcana::cancellation::none());
+            benchmark::DoNotOptimize(task);
+        }
+    }
+    BENCHMARK(MakeTaskOnManualDispatcher);
+
+    // continuations attached to a pending task, all running inline once it completes
+    void InlineThenChain(benchmark::State& state)
+    {
+        const auto length = state.range(0);
+
+        for (auto _ : state)
+        {
+            arcana::task_completion_source<int, std::error_code> source;
+
+            arcana::task<int, std::error_code> task = source.as_task();
+            for (int64_t i = 0; i < length; ++i)
+            {
+                task = task.then(arcana::inline_scheduler, arcana::cancellation::none(), [](int value) noexcept { return value + 1; });
+            }
+
+            source.complete(0);
+            benchmark::DoNotOptimize(task);
+        }
+
+        state.SetItemsProcessed(state.iterations() * length);
+    }
+    BENCHMARK(InlineThenChain)->Arg(1)->Arg(16)->Arg(256);
+
+    // continuations on an already completed task, which run right away without registering a continuation
+    void InlineThenOnReadyTask(benchmark::State& state)
+    {
+        for (auto _ : state)
+        {
+            auto task = arcana::task_from_result<std::error_code>(0)
+                .then(arcana::inline_scheduler, arcana::cancellation::none(), [](int value) noexcept { return value + 1; });
+            benchmark::DoNotOptimize(task);
+        }
+    }
+    BENCHMARK(InlineThenOnReadyTask);
+
+    void WhenAllFanIn(benchmark::State& state)
+    {
+        const auto count = static_cast<size_t>(state.range(0));
+
+        std::vector<arcana::task_completion_source<int, std::error_code>> sources;
+        std::vector<arcana::task<int, std::error_code>> tasks;
+
+        for (auto _ : state)
+        {
+            // completion sources are handles to shared state, so each one has to be created separately
+            state.PauseTiming();
+            sources.clear();
+            tasks.clear();
+            for (size_t i = 0; i < count; ++i)
+            {
+                tasks.push_back(sources.emplace_back().as_task());
+            }
+            state.ResumeTiming();
+
+            auto all = arcana::when_all(gsl::make_span(tasks));
+            for (auto& source : sources)
+            {
+                source.complete(1);
+            }
+
+            benchmark::DoNotOptimize(all);
+        }
+
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+    BENCHMARK(WhenAllFanIn)->Arg(4)->Arg(64)->Arg(1024);
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace arcana::stress
+{
+    using clock = std::chrono::steady_clock;
+
+    //
+    // Latencies recorded by one worker thread. Keeps a uniform sample of at most
+    // capacity latencies (reservoir sampling) so that long runs don't use unbounded memory.
+    //
+    class latency_recorder
+    {
+    public:
+        static constexpr size_t capacity = 1 << 16;
+
+        explicit latency_recorder(uint64_t seed)
+            : m_state{ seed * 0x9E3779B97F4A7C15ull + 1 }
+        {
+            m_samples.reserve(capacity);
+        }
+
+        void record(clock::duration latency)
+        {
+            const auto nanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+
+            ++m_ops;
+            if (m_samples.size() < capacity)
+            {
+                m_samples.push_back(nanoseconds);
+                return;
+            }
+
+            const uint64_t slot = next_random() % m_ops;
+            if (slot < capacity)
+            {
+                m_samples[slot] = nanoseconds;
+            }
+        }
+
+        // operations that completed without a latency of their own
+        void count(uint64_t ops)
+        {
+            m_ops += ops;
+        }
+
+        uint64_t ops() const
+        {
+            return m_ops;
+        }
+
+        const std::vector<uint64_t>& samples() const
+        {
+            return m_samples;
+        }
+
+    private:
+        uint64_t next_random()
+        {
+            // xorshift64
+            m_state ^= m_state << 13;
+            m_state ^= m_state >> 7;
+            m_state ^= m_state << 17;
+            return m_state;
+        }
+
+        uint64_t m_state;
+        uint64_t m_ops = 0;
+        std::vector<uint64_t> m_samples;
+    };
+
+    struct result
+    {
+        std::string scenario;
+        size_t threads;
+        uint64_t ops;
+        std::chrono::nanoseconds elapsed;
+        uint64_t p50;
+        uint64_t p99;
+
+        double ops_per_second() const
+        {
+            return elapsed.count() == 0 ? 0.0 : ops * 1e9 / elapsed.count();
+        }
+    };
+
+    //
+    // Runs body(index, recorder, stop) on the given number of threads until duration elapsed,
+    // with all threads starting at the same time. Bodies loop until stop is set.
+    //
+    template<typename BodyT>
+    result run(const std::string& scenario, size_t threads, std::chrono::milliseconds duration, BodyT&& body)
+    {
+        std::vector<latency_recorder> recorders;
+        for (size_t index = 0; index < threads; ++index)
+        {
+            recorders.emplace_back(index + 1);
+        }
+
+        std::atomic<size_t> ready{ 0 };
+        std::atomic<bool> start{ false };
+        std::atomic<bool> stop{ false };
+
+        std::vector<std::thread> workers;
+        for (size_t index = 0; index < threads; ++index)
+        {
+            workers.emplace_back([&, index] {
+                ready++;
+                while (!start.load(std::memory_order_acquire))
+                {
+                    std::this_thread::yield();
+                }
+
+                body(index, recorders[index], stop);
+            });
+        }
+
+        while (ready != threads)
+        {
+            std::this_thread::yield();
+        }
+
+        const auto begin = clock::now();
+        start.store(true, std::memory_order_release);
+
+        std::this_thread::sleep_for(duration);
+        stop = true;
+
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+
+        const auto elapsed = clock::now() - begin;
+
+        uint64_t ops = 0;
+        std::vector<uint64_t> samples;
+        for (auto& recorder : recorders)
+        {
+            ops += recorder.ops();
+            samples.insert(samples.end(), recorder.samples().begin(), recorder.samples().end());
+        }
+
+        auto percentile = [&samples](double fraction) -> uint64_t {
+            if (samples.empty())
+                return 0;
+
+            const auto nth = samples.begin() + static_cast<ptrdiff_t>(fraction * (samples.size() - 1));
+            std::nth_element(samples.begin(), nth, samples.end());
+            return *nth;
+        };
+
+        return { scenario, threads, ops, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed), percentile(0.5), percentile(0.99) };
+    }
+
+    //
+    // Thread counts to sweep: powers of two up to maxThreads, and maxThreads itself.
+    //
+    inline std::vector<size_t> thread_counts(size_t maxThreads)
+    {
+        std::vector<size_t> counts;
+        for (size_t count = 1; count < maxThreads; count *= 2)
+        {
+            counts.push_back(count);
+        }
+        counts.push_back(std::max<size_t>(maxThreads, 1));
+        return counts;
+    }
+
+    inline void write_csv_header(std::ostream& output)
+    {
+        output << "scenario,threads,ops,elapsed_s,ops_per_s,p50_ns,p99_ns\n";
+    }
+
+    inline void write_csv(std::ostream& output, const result& row)
+    {
+        output << row.scenario << ',' << row.threads << ',' << row.ops << ','
+               << std::chrono::duration<double>(row.elapsed).count() << ','
+               << static_cast<uint64_t>(row.ops_per_second()) << ','
+               << row.p50 << ',' << row.p99 << '\n';
+    }
+}
@@ -0,0 +1,294 @@
+//
+// Sweeps thread counts over contended task system scenarios and reports
+// throughput and latency percentiles per configuration as CSV.
+//
+//   arcana_stress [--threads N] [--duration-ms M] [--scenario NAME] [--output FILE]
+//
+
+#include "StressHarness.h"
+
+#include <arcana/threading/cancellation.h>
+#include <arcana/threading/dispatcher.h>
+#include <arcana/threading/dispatcher_pool.h>
+#include <arcana/threading/task.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+
+using namespace arcana::stress;
+
+namespace
+{
+    struct options
+    {
+        size_t threads = std::max(1u, std::thread::hardware_concurrency());
+        std::chrono::milliseconds duration{ 500 };
+        std::string scenario;
+        std::string output;
+    };
+
+    // recorder of the thread ticking the dispatcher, for the work items it runs
+    thread_local latency_recorder* t_consumer = nullptr;
+
+    //
+    // Producers queue work on a dispatcher ticked by a single consumer,
+    // latency is the time between queueing a work item and it running.
+    //
+    result dispatcher_producers(size_t producers, std::chrono::milliseconds duration)
+    {
+        constexpr int64_t maxInFlight = 1024;
+
+        arcana::manual_dispatcher<64> dispatcher;
+        std::atomic<int64_t> inFlight{ 0 };
+
+        auto row = run("dispatcher_producers", producers + 1, duration, [&](size_t index, latency_recorder& recorder, std::atomic<bool>& stop) {
+            if (index == 0)
+            {
+                dispatcher.set_affinity(std::this_thread::get_id());
+                t_consumer = &recorder;
+
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    if (!dispatcher.tick(arcana::cancellation::none()))
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+                return;
+            }
+
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                if (inFlight.load(std::memory_order_relaxed) >= maxInFlight)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                inFlight++;
+                dispatcher.queue([&inFlight, queued = clock::now()] {
+                    t_consumer->record(clock::now() - queued);
+                    inFlight--;
+                });
+            }
+        });
+
+        row.threads = producers;
+        return row;
+    }
+
+    //
+    // Threads attach continuations to a task while another thread keeps completing
+    // it and replacing it with a new one, latency is the time then() takes.
+    //
+    result then_attach_race(size_t attachers, std::chrono::milliseconds duration)
+    {
+        std::mutex mutex;
+        arcana::task_completion_source<void, std::error_code> current;
+
+        std::atomic<uint64_t> attached{ 0 };
+        std::atomic<uint64_t> ran{ 0 };
+
+        auto row = run("then_attach_race", attachers + 1, duration, [&](size_t index, latency_recorder& recorder, std::atomic<bool>& stop) {
+            if (index == 0)
+            {
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    arcana::task_completion_source<void, std::error_code> completed;
+                    {
+                        std::lock_guard<std::mutex> guard{ mutex };
+                        completed = std::exchange(current, {});
+                    }
+
+                    completed.complete();
+                    std::this_thread::yield();
+                }
+                return;
+            }
+
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                arcana::task<void, std::error_code> task;
+                {
+                    std::lock_guard<std::mutex> guard{ mutex };
+                    task = current.as_task();
+                }
+
+                const auto start = clock::now();
+                task.then(arcana::inline_scheduler, arcana::cancellation::none(), [&ran]() noexcept { ran++; });
+                recorder.record(clock::now() - start);
+
+                attached++;
+            }
+        });
+
+        current.complete();
+        if (ran != attached)
+        {
+            std::cerr << "then_attach_race: " << attached << " continuations attached but " << ran << " ran" << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+
+        row.threads = attachers;
+        return row;
+    }
+
+    //
+    // Threads add and remove cancellation listeners while another thread keeps cancelling
+    // the source and replacing it with a new one, latency is the time add_listener takes.
+    //
+    result cancellation_race(size_t listeners, std::chrono::milliseconds duration)
+    {
+        std::mutex mutex;
+        auto current = std::make_shared<arcana::cancellation_source>();
+        std::atomic<uint64_t> fired{ 0 };
+
+        auto row = run("cancellation_race", listeners + 1, duration, [&](size_t index, latency_recorder& recorder, std::atomic<bool>& stop) {
+            if (index == 0)
+            {
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    std::shared_ptr<arcana::cancellation_source> cancelled;
+                    {
+                        std::lock_guard<std::mutex> guard{ mutex };
+                        cancelled = std::exchange(current, std::make_shared<arcana::cancellation_source>());
+                    }
+
+                    cancelled->cancel();
+                    std::this_thread::yield();
+                }
+                return;
+            }
+
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                std::shared_ptr<arcana::cancellation_source> source;
+                {
+                    std::lock_guard<std::mutex> guard{ mutex };
+                    source = current;
+                }
+
+                const auto start = clock::now();
+                auto ticket = source->add_listener([&fired] { fired++; });
+                recorder.record(clock::now() - start);
+            }
+        });
+
+        row.threads = listeners;
+        return row;
+    }
+
+    //
+    // One thread fans work out over a dispatcher pool and waits for all of it,
+    // latency is the time a whole fan-out takes.
+    //
+    result pool_fanout(size_t dispatchers, std::chrono::milliseconds duration)
+    {
+        constexpr size_t width = 64;
+
+        arcana::dispatcher_pool<64> pool{ dispatchers };
+
+        auto row = run("pool_fanout", 1, duration, [&](size_t, latency_recorder& recorder, std::atomic<bool>& stop) {
+            std::vector<arcana::task<void, std::error_code>> tasks;
+            tasks.reserve(width);
+
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                const auto start = clock::now();
+
+                tasks.clear();
+                for (size_t i = 0; i < width; ++i)
+                {
+                    tasks.push_back(arcana::make_task(pool, arcana::cancellation::none(), []() noexcept {}));
+                }
+                arcana::when_all(gsl::make_span(tasks)).wait();
+
+                recorder.record(clock::now() - start);
+            }
+        });
+
+        row.threads = dispatchers;
+        return row;
+    }
+
+    options parse(int argc, char** argv)
+    {
+        options result;
+
+        for (int index = 1; index < argc; ++index)
+        {
+            const std::string arg = argv[index];
+            const bool hasValue = index + 1 < argc;
+
+            if (arg == "--threads" && hasValue)
+            {
+                result.threads = std::max<size_t>(1, std::strtoul(argv[++index], nullptr, 10));
+            }
+            else if (arg == "--duration-ms" && hasValue)
+            {
+                result.duration = std::chrono::milliseconds{ std::strtoul(argv[++index], nullptr, 10) };
+            }
+            else if (arg == "--scenario" && hasValue)
+            {
+                result.scenario = argv[++index];
+            }
+            else if (arg == "--output" && hasValue)
+            {
+                result.output = argv[++index];
+            }
+            else
+            {
+                std::cerr << "usage: " << argv[0] << " [--threads N] [--duration-ms M] [--scenario NAME] [--output FILE]" << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+        }
+
+        return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const options config = parse(argc, argv);
+
+    std::ofstream file;
+    if (!config.output.empty())
+    {
+        file.open(config.output);
+        if (!file)
+        {
+            std::cerr << "can't write to " << config.output << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::ostream& output = config.output.empty() ? std::cout : file;
+    write_csv_header(output);
+
+    using scenario_t = result (*)(size_t, std::chrono::milliseconds);
+    const std::pair<const char*, scenario_t> scenarios[] = {
+        { "dispatcher_producers", &dispatcher_producers },
+        { "then_attach_race", &then_attach_race },
+        { "cancellation_race", &cancellation_race },
+        { "pool_fanout", &pool_fanout },
+    };
+
+    for (auto& [name, scenario] : scenarios)
+    {
+        if (!config.scenario.empty() && config.scenario != name)
+            continue;
+
+        for (size_t threads : thread_counts(config.threads))
+        {
+            write_csv(output, scenario(threads, config.duration));
+            output.flush();
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
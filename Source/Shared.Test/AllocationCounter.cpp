@@ -0,0 +1,144 @@
+#include "AllocationCounter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace
+{
+    thread_local size_t t_allocations = 0;
+
+    void* allocate(size_t size)
+    {
+        ++t_allocations;
+
+        if (void* memory = std::malloc(size == 0 ? 1 : size))
+            return memory;
+
+        throw std::bad_alloc{};
+    }
+
+    void* allocate(size_t size, std::align_val_t alignment)
+    {
+        ++t_allocations;
+
+        const auto align = static_cast<size_t>(alignment);
+
+        // like malloc, aligned allocators are allowed to return null for zero bytes
+        const size_t bytes = std::max<size_t>(size, 1);
+
+#ifdef _WIN32
+        // the CRT has no aligned_alloc, memory from _aligned_malloc has to go back through _aligned_free
+        if (void* memory = _aligned_malloc(bytes, align))
+            return memory;
+#else
+        // aligned_alloc wants the size to be a multiple of the alignment
+        if (void* memory = std::aligned_alloc(align, (bytes + align - 1) / align * align))
+            return memory;
+#endif
+
+        throw std::bad_alloc{};
+    }
+
+    void deallocate(void* memory, std::align_val_t)
+    {
+#ifdef _WIN32
+        _aligned_free(memory);
+#else
+        std::free(memory);
+#endif
+    }
+}
+
+size_t arcana::test::allocation_count()
+{
+    return t_allocations;
+}
+
+void* operator new(size_t size)
+{
+    return allocate(size);
+}
+
+void* operator new[](size_t size)
+{
+    return allocate(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return allocate(size);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return allocate(size);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    return allocate(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return allocate(size, alignment);
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t alignment) noexcept
+{
+    deallocate(memory, alignment);
+}
+
+void operator delete[](void* memory, std::align_val_t alignment) noexcept
+{
+    deallocate(memory, alignment);
+}
+
+void operator delete(void* memory, size_t, std::align_val_t alignment) noexcept
+{
+    deallocate(memory, alignment);
+}
+
+void operator delete[](void* memory, size_t, std::align_val_t alignment) noexcept
+{
+    deallocate(memory, alignment);
+}
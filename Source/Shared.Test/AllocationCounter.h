@@ -0,0 +1,58 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+
+namespace arcana::test
+{
+    //
+    // Number of allocations made through the global operator new on the calling thread
+    // since it started. The test binary replaces the global operator new to count them.
+    //
+    size_t allocation_count();
+
+    //
+    // Counts the allocations the calling thread makes while the counter is alive.
+    //
+    class allocation_counter
+    {
+    public:
+        allocation_counter()
+            : m_start{ allocation_count() }
+        {}
+
+        size_t allocations() const
+        {
+            return allocation_count() - m_start;
+        }
+
+    private:
+        size_t m_start;
+    };
+}
+
+//
+// Checks how many times a block of code allocates on the calling thread, which makes
+// allocation budgets of hot paths part of their tests. Work the block hands off to other
+// threads isn't counted.
+//
+//   EXPECT_NO_ALLOCATIONS({ router.fire(event{}); });
+//
+#define EXPECT_ALLOCATIONS(expected, ...) \
+    do \
+    { \
+        arcana::test::allocation_counter allocationCounter_; \
+        __VA_ARGS__; \
+        EXPECT_EQ(static_cast<size_t>(expected), allocationCounter_.allocations()) << "allocations made by " #__VA_ARGS__; \
+    } while (false)
+
+#define EXPECT_MAX_ALLOCATIONS(budget, ...) \
+    do \
+    { \
+        arcana::test::allocation_counter allocationCounter_; \
+        __VA_ARGS__; \
+        EXPECT_LE(allocationCounter_.allocations(), static_cast<size_t>(budget)) << "allocations made by " #__VA_ARGS__; \
+    } while (false)
+
+#define EXPECT_NO_ALLOCATIONS(...) EXPECT_ALLOCATIONS(0, __VA_ARGS__)
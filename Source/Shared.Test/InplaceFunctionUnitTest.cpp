@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include "AllocationCounter.h"
+
 #include <arcana/functional/inplace_function.h>
 
 #include <memory>
@@ -25,3 +27,20 @@ TEST(InplaceFunctionUnitTest, MovedFunctionGetsPropertyDestroyed)
 
     EXPECT_TRUE(weak.expired());
 }
+
+TEST(InplaceFunctionUnitTest, DoesNotAllocate)
+{
+    const std::shared_ptr<int> value = std::make_shared<int>(10);
+    int result = 0;
+
+    EXPECT_NO_ALLOCATIONS({
+        stdext::inplace_function<void()> source = [value, &result] { result = *value; };
+        stdext::inplace_function<void()> copy = source;
+        stdext::inplace_function<void()> moved = std::move(source);
+
+        copy();
+        moved();
+    });
+
+    EXPECT_EQ(10, result);
+}
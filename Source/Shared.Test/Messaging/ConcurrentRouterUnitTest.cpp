@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+
+#include <arcana/messaging/concurrent_router.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct position
+    {
+        int value;
+    };
+
+    struct removed
+    {};
+}
+
+TEST(ConcurrentRouterUnitTest, FireAndUnregister)
+{
+    arcana::concurrent_router<position, removed> rout;
+
+    int received = 0;
+    {
+        auto reg = rout.add_listener<position>([&received](const position& evt) { received += evt.value; });
+
+        rout.fire(position{ 2 });
+        rout.fire(removed{});
+        EXPECT_EQ(2, received);
+    }
+
+    rout.fire(position{ 2 });
+    EXPECT_EQ(2, received);
+}
+
+TEST(ConcurrentRouterUnitTest, ChangeListenersWhileFiring)
+{
+    arcana::concurrent_router<position> rout;
+
+    struct
+    {
+        int first = 0;
+        int second = 0;
+        std::unique_ptr<arcana::ticket> self;
+        std::unique_ptr<arcana::ticket> added;
+    } state;
+
+    // fires keep going with the listeners they started with
+    state.self = std::make_unique<arcana::ticket>(rout.add_listener<position>([&rout, &state](const position&) {
+        state.first++;
+        state.self.reset();
+        state.added = std::make_unique<arcana::ticket>(rout.add_listener<position>([&state](const position&) { state.second++; }));
+        rout.fire(position{});
+    }));
+
+    rout.fire(position{});
+    EXPECT_EQ(1, state.first);
+    EXPECT_EQ(1, state.second);
+
+    rout.fire(position{});
+    EXPECT_EQ(1, state.first);
+    EXPECT_EQ(2, state.second);
+}
+
+TEST(ConcurrentRouterUnitTest, FireFromManyThreads)
+{
+    arcana::concurrent_router<position> rout;
+
+    constexpr int threadCount = 4;
+    constexpr int firesPerThread = 2000;
+
+    std::atomic<int> sum{ 0 };
+    auto reg = rout.add_listener<position>([&sum](const position& evt) { sum.fetch_add(evt.value, std::memory_order_relaxed); });
+
+    std::atomic<bool> done{ false };
+    std::atomic<int> churned{ 0 };
+
+    // listeners coming and going while firing can't affect the ones that stay registered
+    std::thread churn{ [&] {
+        while (!done.load())
+        {
+            auto temporary = rout.add_listener<position>([&churned](const position&) { churned++; });
+        }
+    } };
+
+    std::vector<std::thread> firing;
+    for (int i = 0; i < threadCount; ++i)
+    {
+        firing.emplace_back([&rout] {
+            for (int fire = 0; fire < firesPerThread; ++fire)
+            {
+                rout.fire(position{ 1 });
+            }
+        });
+    }
+
+    for (auto& thread : firing)
+    {
+        thread.join();
+    }
+
+    done = true;
+    churn.join();
+
+    EXPECT_EQ(threadCount * firesPerThread, sum.load());
+}
+
+TEST(ConcurrentRouterUnitTest, ReleasedTicketsWaitForRunningFires)
+{
+    arcana::concurrent_router<position> rout;
+
+    struct captured
+    {
+        std::atomic<bool> running{ false };
+        std::atomic<bool> alive{ true };
+    };
+
+    std::atomic<bool> done{ false };
+    std::atomic<int> calledAfterRelease{ 0 };
+
+    std::thread firing{ [&] {
+        while (!done.load())
+        {
+            rout.fire(position{ 1 });
+        }
+    } };
+
+    // kept alive past their "destruction" so that late calls can be detected
+    std::array<captured, 20> states;
+
+    for (auto& destroyed : states)
+    {
+        {
+            auto reg = rout.add_listener<position>([&calledAfterRelease, state = &destroyed](const position&) {
+                state->running = true;
+                std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+                if (!state->alive.load())
+                {
+                    calledAfterRelease++;
+                }
+            });
+
+            // release the ticket while the listener is running on the other thread
+            while (!destroyed.running.load())
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        // the usual pattern, destroying what the listener captured right after releasing its ticket
+        destroyed.alive = false;
+    }
+
+    done = true;
+    firing.join();
+
+    EXPECT_EQ(0, calledAfterRelease.load());
+}
@@ -1,10 +1,17 @@
 #include <gtest/gtest.h>
 
+#include "AllocationCounter.h"
+
 #include <arcana/functional/inplace_function.h>
 #include <arcana/messaging/mediator.h>
 #include <arcana/expected.h>
 
+#include <algorithm>
 #include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace
 {
@@ -372,6 +379,185 @@ TEST(MediatorUnitTest, RouterFire)
     EXPECT_EQ(13, received);
 }
 
+TEST(MediatorUnitTest, RouterRemoveKeepsOrder)
+{
+    arcana::router<one> rout;
+
+    std::vector<int> received;
+    std::vector<std::unique_ptr<arcana::ticket>> tickets;
+    for (int i = 0; i < 8; ++i)
+    {
+        tickets.push_back(std::make_unique<arcana::ticket>(rout.add_listener<one>([&received, i](const one&) {
+            received.push_back(i);
+        })));
+    }
+
+    // removing most of the listeners compacts the list
+    for (int i : { 1, 2, 4, 5, 6 })
+    {
+        tickets[i].reset();
+    }
+
+    rout.fire(one{});
+    EXPECT_EQ((std::vector<int>{ 0, 3, 7 }), received);
+
+    // the freed slots get reused, the new listeners still come last
+    received.clear();
+    tickets[1] = std::make_unique<arcana::ticket>(rout.add_listener<one>([&received](const one&) { received.push_back(10); }));
+    tickets[2] = std::make_unique<arcana::ticket>(rout.add_listener<one>([&received](const one&) { received.push_back(11); }));
+    tickets[3].reset();
+
+    rout.fire(one{});
+    EXPECT_EQ((std::vector<int>{ 0, 7, 10, 11 }), received);
+}
+
+TEST(MediatorUnitTest, RouterRemoveOthersWhileFiring)
+{
+    arcana::router<one> rout;
+
+    struct
+    {
+        int first = 0;
+        int last = 0;
+        std::unique_ptr<arcana::ticket> lastTicket;
+        std::unique_ptr<arcana::ticket> added;
+    } state;
+
+    auto firstTicket = rout.add_listener<one>([&rout, &state](const one&) {
+        state.first++;
+
+        // remove a listener that hasn't run yet and replace it, the
+        // replacement reuses its slot but shouldn't run in this fire
+        state.lastTicket.reset();
+        state.added = std::make_unique<arcana::ticket>(rout.add_listener<one>([&state](const one&) { state.last += 10; }));
+    });
+
+    state.lastTicket = std::make_unique<arcana::ticket>(rout.add_listener<one>([&state](const one&) { state.last++; }));
+
+    rout.fire(one{});
+    EXPECT_EQ(1, state.first);
+    EXPECT_EQ(0, state.last);
+
+    state.added.reset();
+    rout.fire(one{});
+    EXPECT_EQ(2, state.first);
+    EXPECT_EQ(0, state.last);
+}
+
+TEST(MediatorUnitTest, RouterListenerChurn)
+{
+    arcana::router<one> rout;
+
+    int received = 0;
+    std::vector<std::unique_ptr<arcana::ticket>> tickets;
+    for (int i = 0; i < 1000; ++i)
+    {
+        tickets.push_back(std::make_unique<arcana::ticket>(rout.add_listener<one>([&received](const one&) { received++; })));
+    }
+
+    for (int round = 0; round < 10; ++round)
+    {
+        for (size_t i = round % 2; i < tickets.size(); i += 2)
+        {
+            tickets[i] = std::make_unique<arcana::ticket>(rout.add_listener<one>([&received](const one&) { received++; }));
+        }
+
+        received = 0;
+        rout.fire(one{});
+        EXPECT_EQ(1000, received);
+    }
+
+    tickets.clear();
+
+    received = 0;
+    rout.fire(one{});
+    EXPECT_EQ(0, received);
+}
+
+TEST(MediatorUnitTest, RouterFireBatch)
+{
+    arcana::router<one> rout;
+
+    std::vector<int> single;
+    std::vector<size_t> batches;
+    int sum = 0;
+
+    auto singleReg = rout.add_listener<one>([&single](const one& evt) { single.push_back(evt.value); });
+    auto batchReg = std::make_unique<arcana::ticket>(rout.add_batch_listener<one>([&batches, &sum](gsl::span<const one> events) {
+        batches.push_back(events.size());
+        for (const one& evt : events)
+        {
+            sum += evt.value;
+        }
+    }));
+
+    std::vector<one> events{ one{ 1 }, one{ 2 }, one{ 3 } };
+    rout.fire_batch<one>(events);
+
+    EXPECT_EQ((std::vector<int>{ 1, 2, 3 }), single);
+    EXPECT_EQ((std::vector<size_t>{ 3 }), batches);
+    EXPECT_EQ(6, sum);
+
+    // single events come as batches of one
+    rout.fire(one{ 4 });
+    EXPECT_EQ((std::vector<size_t>{ 3, 1 }), batches);
+    EXPECT_EQ(10, sum);
+
+    batchReg.reset();
+    rout.fire_batch<one>(events);
+    EXPECT_EQ((std::vector<size_t>{ 3, 1 }), batches);
+    EXPECT_EQ(7u, single.size());
+}
+
+TEST(MediatorUnitTest, RouterKeyedListeners)
+{
+    arcana::router<one> rout;
+
+    std::vector<std::string> received;
+    auto broadcast = rout.add_listener<one>([&received](const one& evt) { received.push_back("all " + std::to_string(evt.value)); });
+    auto first = std::make_unique<arcana::ticket>(rout.add_listener<one>(1, [&received](const one& evt) { received.push_back("1: " + std::to_string(evt.value)); }));
+    auto second = rout.add_listener<one>(2, [&received](const one& evt) { received.push_back("2: " + std::to_string(evt.value)); });
+
+    rout.fire(1, one{ 10 });
+    rout.fire(3, one{ 30 });
+    rout.fire(one{ 0 });
+    EXPECT_EQ((std::vector<std::string>{ "all 10", "1: 10", "all 30", "all 0" }), received);
+
+    received.clear();
+    first.reset();
+    rout.fire(1, one{ 11 });
+    rout.fire(2, one{ 20 });
+    EXPECT_EQ((std::vector<std::string>{ "all 11", "all 20", "2: 20" }), received);
+}
+
+TEST(MediatorUnitTest, RouterKeyedListenerRemovesItself)
+{
+    arcana::router<one> rout;
+
+    struct
+    {
+        int received = 0;
+        std::unique_ptr<arcana::ticket> self;
+        std::unique_ptr<arcana::ticket> other;
+    } state;
+
+    // the last listener for a key going away while that key fires, while adding other keys
+    state.self = std::make_unique<arcana::ticket>(rout.add_listener<one>(5, [&rout, &state](const one&) {
+        state.received++;
+        state.self.reset();
+        state.other = std::make_unique<arcana::ticket>(rout.add_listener<one>(6, [&state](const one&) { state.received += 10; }));
+    }));
+
+    rout.fire(5, one{});
+    rout.fire(5, one{});
+    EXPECT_EQ(1, state.received);
+
+    state.self = std::make_unique<arcana::ticket>(rout.add_listener<one>(5, [&state](const one&) { state.received += 100; }));
+    rout.fire(5, one{});
+    rout.fire(6, one{});
+    EXPECT_EQ(111, state.received);
+}
+
 TEST(MediatorUnitTest, DispatcherOrdering)
 {
     arcana::manual_dispatcher<32> dis;
@@ -537,3 +723,169 @@ TEST(MediatorUnitTest, MultipleEvents)
 
     EXPECT_EQ(4596738, received);
 }
+
+TEST(MediatorUnitTest, SendLatestDeliversOnce)
+{
+    arcana::manual_dispatcher<64> dis;
+    arcana::mediator<decltype(dis), one, two> med{ dis };
+    arcana::ticket_scope registrations;
+
+    std::vector<int> received;
+    registrations += med.add_listener<one>([&received](const one& evt) { received.push_back(evt.value); });
+    registrations += med.add_listener<two>([&received](const two&) { received.push_back(-1); });
+
+    for (int i = 0; i < 100; ++i)
+    {
+        med.send_latest(one{ i });
+    }
+    med.send(two{});
+    med.send_latest(one{ 100 });
+
+    arcana::cancellation_source source;
+    dis.tick(source);
+
+    // delivered where the first of the coalesced events was sent
+    EXPECT_EQ((std::vector<int>{ 100, -1 }), received);
+
+    received.clear();
+    dis.tick(source);
+    EXPECT_TRUE(received.empty());
+
+    med.send_latest(one{ 7 });
+    dis.tick(source);
+    EXPECT_EQ((std::vector<int>{ 7 }), received);
+}
+
+TEST(MediatorUnitTest, SendLatestFromManyThreads)
+{
+    arcana::manual_dispatcher<32> dis;
+    arcana::mediator<decltype(dis), one> med{ dis };
+
+    std::vector<int> received;
+    auto reg = med.add_listener<one>([&received](const one& evt) { received.push_back(evt.value); });
+
+    // the first sends race to allocate the pending state of the event type
+    std::vector<std::thread> senders;
+    for (size_t key = 0; key < 8; ++key)
+    {
+        senders.emplace_back([&med, key] { med.send_latest(key, one{ static_cast<int>(key) }); });
+    }
+    for (auto& sender : senders)
+    {
+        sender.join();
+    }
+
+    arcana::cancellation_source source;
+    dis.tick(source);
+
+    std::sort(received.begin(), received.end());
+    EXPECT_EQ((std::vector<int>{ 0, 1, 2, 3, 4, 5, 6, 7 }), received);
+}
+
+TEST(MediatorUnitTest, SendLatestPerKey)
+{
+    arcana::manual_dispatcher<32> dis;
+    arcana::mediator<decltype(dis), one> med{ dis };
+
+    std::vector<int> received;
+    auto reg = med.add_listener<one>([&received](const one& evt) { received.push_back(evt.value); });
+
+    med.send_latest(2, one{ 20 });
+    med.send_latest(1, one{ 10 });
+    med.send_latest(2, one{ 21 });
+    med.send_latest(3, one{ 30 });
+    med.send_latest(1, one{ 11 });
+
+    arcana::cancellation_source source;
+    dis.tick(source);
+
+    EXPECT_EQ((std::vector<int>{ 21, 11, 30 }), received);
+
+    // keys that keep getting sent don't allocate once warm
+    received.clear();
+    received.reserve(8);
+    EXPECT_NO_ALLOCATIONS({
+        med.send_latest(3, one{ 31 });
+        med.send_latest(1, one{ 12 });
+        med.send_latest(1, one{ 13 });
+        med.send_latest(2, one{ 22 });
+        dis.tick(source);
+    });
+
+    EXPECT_EQ((std::vector<int>{ 31, 13, 22 }), received);
+}
+
+TEST(MediatorUnitTest, MediatorIsMovable)
+{
+    using mediator_t = arcana::mediator<arcana::manual_dispatcher<32>, one, two>;
+    static_assert(std::is_move_constructible<mediator_t>::value, "mediators without pending events can be moved");
+
+    arcana::manual_dispatcher<32> dis;
+    mediator_t original{ dis };
+    mediator_t med{ std::move(original) };
+
+    int sum = 0;
+    auto reg = med.add_listener<one>([&sum](const one& evt) { sum += evt.value; });
+
+    med.send_latest(one{ 1 });
+    med.send_batched(one{ 2 });
+
+    arcana::cancellation_source source;
+    dis.tick(source);
+
+    EXPECT_EQ(3, sum);
+}
+
+TEST(MediatorUnitTest, SendBatched)
+{
+    arcana::manual_dispatcher<32> dis;
+    arcana::mediator<decltype(dis), one> med{ dis };
+    arcana::ticket_scope registrations;
+
+    std::vector<size_t> batches;
+    int sum = 0;
+    registrations += med.add_batch_listener<one>([&batches](gsl::span<const one> events) { batches.push_back(events.size()); });
+    registrations += med.add_listener<one>([&sum](const one& evt) { sum += evt.value; });
+
+    for (int i = 1; i <= 10; ++i)
+    {
+        med.send_batched(one{ i });
+    }
+
+    arcana::cancellation_source source;
+    dis.tick(source);
+
+    EXPECT_EQ((std::vector<size_t>{ 10 }), batches);
+    EXPECT_EQ(55, sum);
+
+    // the buffer gets reused once warm
+    batches.reserve(8);
+    EXPECT_NO_ALLOCATIONS({
+        for (int i = 0; i < 10; ++i)
+        {
+            med.send_batched(one{ 1 });
+        }
+        dis.tick(source);
+    });
+
+    EXPECT_EQ((std::vector<size_t>{ 10, 10 }), batches);
+    EXPECT_EQ(65, sum);
+}
+
+TEST(MediatorUnitTest, RouterFireDoesNotAllocate)
+{
+    arcana::router<one> rout;
+
+    int fired = 0;
+    auto first = rout.add_listener<one>([&fired](const one&) { ++fired; });
+    auto second = rout.add_listener<one>([&fired](const one&) { ++fired; });
+
+    EXPECT_NO_ALLOCATIONS({
+        for (int i = 0; i < 10; ++i)
+        {
+            rout.fire(one{});
+        }
+    });
+
+    EXPECT_EQ(20, fired);
+}
@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+
+#include <arcana/threading/async_memo_cache.h>
+#include <arcana/threading/dispatcher.h>
+
+#include <string>
+
+namespace
+{
+    using cache_t = arcana::async_memo_cache<int, std::string, std::error_code>;
+}
+
+TEST(AsyncMemoCacheUnitTest, ConcurrentRequestsShareOneInFlightTask)
+{
+    cache_t cache{ 8 };
+    arcana::task_completion_source<std::string, std::error_code> work;
+    int calls = 0;
+
+    auto factory = [&] {
+        ++calls;
+        return work.as_task();
+    };
+
+    std::vector<std::string> results;
+    for (int i = 0; i < 3; ++i)
+    {
+        cache.get_or_add(1, factory).then(arcana::inline_scheduler, arcana::cancellation::none(), [&](const std::string& value) {
+            results.push_back(value);
+        });
+    }
+
+    EXPECT_EQ(1, calls);
+    EXPECT_TRUE(results.empty());
+
+    work.complete(std::string{ "one" });
+
+    EXPECT_EQ(std::vector<std::string>(3, "one"), results);
+}
+
+TEST(AsyncMemoCacheUnitTest, CompletedResultsAreMemoized)
+{
+    cache_t cache{ 8 };
+    int calls = 0;
+
+    auto factory = [&] {
+        ++calls;
+        return arcana::task_from_result<std::error_code>(std::string{ "value" });
+    };
+
+    EXPECT_EQ("value", cache.get_or_add(1, factory).get().value());
+    EXPECT_EQ("value", cache.get_or_add(1, factory).get().value());
+    EXPECT_EQ(1, calls);
+
+    cache.erase(1);
+
+    EXPECT_EQ("value", cache.get_or_add(1, factory).get().value());
+    EXPECT_EQ(2, calls);
+}
+
+TEST(AsyncMemoCacheUnitTest, ErrorsAreNotMemoized)
+{
+    cache_t cache{ 8 };
+    int calls = 0;
+
+    auto factory = [&] {
+        ++calls;
+        return arcana::task_from_error<std::string>(std::make_error_code(std::errc::io_error));
+    };
+
+    EXPECT_TRUE(cache.get_or_add(1, factory).get().has_error());
+    EXPECT_EQ(0u, cache.size());
+    EXPECT_TRUE(cache.get_or_add(1, factory).get().has_error());
+    EXPECT_EQ(2, calls);
+}
+
+TEST(AsyncMemoCacheUnitTest, LeastRecentlyUsedEntriesGetEvicted)
+{
+    cache_t cache{ 2, 1 };
+    std::vector<int> calls;
+
+    auto request = [&](int key) {
+        return cache.get_or_add(key, [&] {
+            calls.push_back(key);
+            return arcana::task_from_result<std::error_code>(std::to_string(key));
+        });
+    };
+
+    request(1);
+    request(2);
+    request(1); // 2 is now the least recently used
+    request(3);
+
+    EXPECT_EQ(2u, cache.size());
+
+    request(1);
+    request(2);
+
+    EXPECT_EQ((std::vector<int>{ 1, 2, 3, 2 }), calls);
+}
+
+TEST(AsyncMemoCacheUnitTest, SmallCapacitiesAreHonoredWithTheDefaultShards)
+{
+    for (size_t capacity : { 1u, 3u, 17u })
+    {
+        cache_t cache{ capacity };
+
+        for (int key = 0; key < 100; ++key)
+        {
+            cache.get_or_add(key, [key] { return arcana::task_from_result<std::error_code>(std::to_string(key)); });
+        }
+
+        EXPECT_EQ(capacity, cache.size());
+    }
+}
+
+TEST(AsyncMemoCacheUnitTest, FactoryExceptionsAreForwarded)
+{
+    arcana::async_memo_cache<int, int, std::exception_ptr> cache{ 8 };
+
+    auto result = cache.get_or_add(1, []() -> arcana::task<int, std::exception_ptr> {
+        throw std::runtime_error("failed");
+    });
+
+    EXPECT_TRUE(result.get().has_error());
+    EXPECT_EQ(0u, cache.size());
+}
+
+TEST(AsyncMemoCacheUnitTest, RequestsOutliveTheCache)
+{
+    arcana::task_completion_source<std::string, std::error_code> work;
+    arcana::task<std::string, std::error_code> result;
+
+    {
+        cache_t cache{ 8 };
+        result = cache.get_or_add(1, [&] { return work.as_task(); });
+    }
+
+    work.complete(std::string{ "late" });
+
+    EXPECT_EQ("late", result.get().value());
+}
+
+TEST(AsyncMemoCacheUnitTest, ConcurrentRequestsFromManyThreads)
+{
+    cache_t cache{ 64, 4 };
+    std::atomic<int> calls{ 0 };
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&] {
+            arcana::background_dispatcher<32> worker;
+            for (int i = 0; i < 1000; ++i)
+            {
+                const int key = i % 32;
+                auto value = cache.get_or_add(key, [&] {
+                    ++calls;
+                    return arcana::make_task(worker, arcana::cancellation::none(), [key]() noexcept {
+                        return std::to_string(key);
+                    });
+                }).get();
+
+                EXPECT_EQ(std::to_string(key), value.value());
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(32, calls.load());
+}
@@ -1,10 +1,21 @@
 #include <gtest/gtest.h>
 
+#include "AllocationCounter.h"
+
 #include <arcana/threading/dispatcher.h>
+#include <arcana/threading/dispatcher_pool.h>
+#include <arcana/threading/dispatcher_watchdog.h>
+#include <arcana/threading/priority_dispatcher.h>
+#include <arcana/threading/task.h>
 
 #include <numeric>
 #include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
 #include <future>
+#include <thread>
 
 TEST(DispatcherUnitTest, DispatcherLeakCheck)
 {
@@ -27,3 +38,431 @@ TEST(DispatcherUnitTest, DispatcherLeakCheck)
 
     EXPECT_TRUE(weak.expired());
 }
+
+TEST(DispatcherUnitTest, InlineIfAffineRunsInlineOnDispatcherThread)
+{
+    arcana::manual_dispatcher<32> dis;
+    dis.set_affinity(std::this_thread::get_id());
+
+    arcana::inline_if_affine_scheduler scheduler{ dis };
+
+    int hit = 0;
+    scheduler([&hit] { hit++; });
+
+    EXPECT_EQ(1, hit);
+    EXPECT_FALSE(dis.tick(arcana::cancellation::none()));
+}
+
+TEST(DispatcherUnitTest, InlineIfAffineQueuesWithoutAffinity)
+{
+    arcana::manual_dispatcher<32> dis;
+    arcana::inline_if_affine_scheduler scheduler{ dis };
+
+    int hit = 0;
+    scheduler([&hit] { hit++; });
+
+    EXPECT_EQ(0, hit);
+    EXPECT_TRUE(dis.tick(arcana::cancellation::none()));
+    EXPECT_EQ(1, hit);
+}
+
+TEST(DispatcherUnitTest, InlineIfAffineQueuesFromOtherThread)
+{
+    arcana::manual_dispatcher<32> dis;
+    dis.set_affinity(std::this_thread::get_id());
+
+    arcana::inline_if_affine_scheduler scheduler{ dis };
+
+    int hit = 0;
+    std::thread{ [&] { scheduler([&hit] { hit++; }); } }.join();
+
+    EXPECT_EQ(0, hit);
+    EXPECT_TRUE(dis.tick(arcana::cancellation::none()));
+    EXPECT_EQ(1, hit);
+}
+
+TEST(DispatcherUnitTest, InlineIfAffineBoundsRecursion)
+{
+    arcana::manual_dispatcher<32> dis;
+    dis.set_affinity(std::this_thread::get_id());
+
+    arcana::inline_if_affine_scheduler<arcana::manual_dispatcher<32>, 4> scheduler{ dis };
+
+    size_t inlined = 0;
+    std::function<void()> recurse = [&] {
+        inlined++;
+        scheduler([&] { recurse(); });
+    };
+
+    scheduler([&] { recurse(); });
+
+    EXPECT_EQ(decltype(scheduler)::max_depth, inlined);
+    EXPECT_TRUE(dis.tick(arcana::cancellation::none()));
+    EXPECT_EQ(2 * decltype(scheduler)::max_depth + 1, inlined);
+}
+
+TEST(DispatcherUnitTest, PriorityDispatcherRunsUrgentWorkFirst)
+{
+    arcana::manual_priority_dispatcher<32> dis;
+
+    std::vector<int> order;
+    dis.at(arcana::priority::low)([&] { order.push_back(3); });
+    dis.at(arcana::priority::normal)([&] { order.push_back(2); });
+    dis.at(arcana::priority::high)([&] { order.push_back(1); });
+
+    EXPECT_TRUE(dis.tick(arcana::cancellation::none()));
+    EXPECT_EQ((std::vector<int>{ 1, 2, 3 }), order);
+    EXPECT_FALSE(dis.tick(arcana::cancellation::none()));
+}
+
+TEST(DispatcherUnitTest, PriorityDispatcherDoesNotStarveLowPriorityWork)
+{
+    arcana::manual_priority_dispatcher<32> dis;
+    auto& high = dis.at(arcana::priority::high);
+
+    // high priority work that keeps queueing more of itself
+    size_t highRuns = 0;
+    std::function<void()> flood = [&] {
+        highRuns++;
+        high([&] { flood(); });
+    };
+
+    for (int i = 0; i < 16; ++i)
+    {
+        high([&] { flood(); });
+    }
+
+    bool lowRan = false;
+    dis.at(arcana::priority::low)([&] { lowRan = true; });
+
+    EXPECT_TRUE(dis.tick(arcana::cancellation::none()));
+    EXPECT_TRUE(lowRan);
+    EXPECT_EQ(16u, highRuns);
+}
+
+TEST(DispatcherUnitTest, PriorityDispatcherWorksWithContinuations)
+{
+    arcana::background_priority_dispatcher<32> dis;
+
+    auto result = arcana::make_task(dis.at(arcana::priority::low), arcana::cancellation::none(), []() noexcept {
+        return 1;
+    }).then(dis.at(arcana::priority::high), arcana::cancellation::none(), [&](int value) noexcept {
+        EXPECT_TRUE(dis.get_affinity().check());
+        return value + 1;
+    });
+
+    EXPECT_EQ(2, result.get().value());
+}
+
+TEST(DispatcherUnitTest, PriorityDispatcherTickRunsItsSnapshot)
+{
+    arcana::manual_priority_dispatcher<32> dis;
+    arcana::cancellation_source cancel;
+
+    // urgent work queued during a tick waits for the next one, like it does on a dispatcher
+    std::vector<int> order;
+    dis.at(arcana::priority::low)([&] {
+        order.push_back(2);
+        dis.at(arcana::priority::high)([&] { order.push_back(3); });
+        cancel.cancel();
+    });
+    dis.at(arcana::priority::normal)([&] { order.push_back(1); });
+
+    EXPECT_TRUE(dis.tick(cancel));
+    EXPECT_EQ((std::vector<int>{ 1, 2 }), order);
+    EXPECT_FALSE(dis.tick(cancel));
+    EXPECT_TRUE(dis.tick(arcana::cancellation::none()));
+    EXPECT_EQ((std::vector<int>{ 1, 2, 3 }), order);
+    EXPECT_FALSE(dis.tick(arcana::cancellation::none()));
+}
+
+TEST(DispatcherUnitTest, PriorityDispatcherMetrics)
+{
+    arcana::manual_priority_dispatcher<32, 3, arcana::spin_then_park_wait_policy<>, arcana::dispatcher_metrics> dis;
+
+    dis.at(arcana::priority::low)([] {});
+    dis.at(arcana::priority::high)([] {});
+    EXPECT_EQ(2u, dis.metrics().depth);
+
+    EXPECT_TRUE(dis.tick(arcana::cancellation::none()));
+
+    const auto metrics = dis.metrics();
+    EXPECT_EQ(0u, metrics.depth);
+    EXPECT_EQ(2u, metrics.high_water_depth);
+    EXPECT_EQ(2u, metrics.items_run);
+    EXPECT_EQ(1u, metrics.ticks);
+}
+
+TEST(DispatcherUnitTest, SpinThenParkDispatcherPingPong)
+{
+    using spinning_dispatcher = arcana::background_dispatcher<32, arcana::spin_then_park_wait_policy<>>;
+    spinning_dispatcher ping;
+    spinning_dispatcher pong;
+
+    std::promise<int> done;
+    std::function<void(int)> bounce = [&](int remaining) {
+        if (remaining == 0)
+        {
+            done.set_value(0);
+            return;
+        }
+
+        auto& next = remaining % 2 ? ping : pong;
+        next.queue([&bounce, remaining] { bounce(remaining - 1); });
+    };
+
+    bounce(1000);
+
+    EXPECT_EQ(0, done.get_future().get());
+}
+
+TEST(DispatcherUnitTest, SpinThenParkDispatcherParksWhenIdle)
+{
+    arcana::background_dispatcher<32, arcana::spin_then_park_wait_policy<>> dis;
+
+    // let the dispatcher thread finish spinning and park before waking it up
+    std::this_thread::sleep_for(std::chrono::milliseconds{ 20 });
+
+    std::promise<void> ran;
+    dis.queue([&] { ran.set_value(); });
+
+    EXPECT_EQ(std::future_status::ready, ran.get_future().wait_for(std::chrono::seconds{ 5 }));
+}
+
+TEST(DispatcherUnitTest, BackgroundDispatcherRunsInitOnItsThread)
+{
+    std::promise<std::thread::id> initThread;
+    arcana::background_dispatcher<32> dis{ [&] { initThread.set_value(std::this_thread::get_id()); } };
+
+    std::promise<std::thread::id> workThread;
+    dis.queue([&] { workThread.set_value(std::this_thread::get_id()); });
+
+    EXPECT_EQ(initThread.get_future().get(), workThread.get_future().get());
+}
+
+TEST(DispatcherUnitTest, DispatcherPoolRoutesWork)
+{
+    std::mutex mutex;
+    std::map<std::thread::id, size_t> indices;
+
+    arcana::dispatcher_pool<32> pool{ 3, [&](size_t index) {
+        std::lock_guard<std::mutex> guard{ mutex };
+        indices[std::this_thread::get_id()] = index;
+    } };
+
+    auto indexOf = [&](auto& scheduler) {
+        return arcana::make_task(scheduler, arcana::cancellation::none(), [&]() noexcept {
+            std::lock_guard<std::mutex> guard{ mutex };
+            return indices.at(std::this_thread::get_id());
+        }).get().value();
+    };
+
+    EXPECT_EQ(0u, indexOf(pool));
+    EXPECT_EQ(1u, indexOf(pool));
+    EXPECT_EQ(2u, indexOf(pool));
+    EXPECT_EQ(0u, indexOf(pool));
+
+    const size_t keyed = indexOf(pool.for_key(std::string{ "asset" }));
+    for (int i = 0; i < 8; ++i)
+    {
+        EXPECT_EQ(keyed, indexOf(pool.for_key(std::string{ "asset" })));
+    }
+
+    EXPECT_EQ(1u, indexOf(pool.at(1)));
+}
+
+TEST(DispatcherUnitTest, DispatcherMetricsTrackDepthWaitAndTicks)
+{
+    arcana::manual_dispatcher<32, arcana::park_wait_policy, arcana::dispatcher_metrics> dispatcher;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        dispatcher.queue([] { std::this_thread::sleep_for(std::chrono::milliseconds{ 1 }); });
+    }
+
+    auto metrics = dispatcher.metrics();
+    EXPECT_EQ(3u, metrics.depth);
+    EXPECT_EQ(3u, metrics.high_water_depth);
+    EXPECT_EQ(0u, metrics.items_run);
+    EXPECT_EQ(0u, metrics.ticks);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds{ 2 });
+    EXPECT_TRUE(dispatcher.tick(arcana::cancellation::none()));
+
+    metrics = dispatcher.metrics();
+    EXPECT_EQ(0u, metrics.depth);
+    EXPECT_EQ(3u, metrics.high_water_depth);
+    EXPECT_EQ(3u, metrics.items_run);
+    EXPECT_GE(metrics.max_wait, std::chrono::milliseconds{ 2 });
+    EXPECT_GE(metrics.total_wait, 3 * std::chrono::milliseconds{ 2 });
+    EXPECT_EQ(1u, metrics.ticks);
+    EXPECT_GE(metrics.max_tick, std::chrono::milliseconds{ 3 });
+    EXPECT_EQ(metrics.max_tick, metrics.total_tick);
+
+    dispatcher.reset_metrics();
+    dispatcher.queue([] {});
+
+    metrics = dispatcher.metrics();
+    EXPECT_EQ(1u, metrics.high_water_depth);
+    EXPECT_EQ(0u, metrics.items_run);
+    EXPECT_EQ(std::chrono::nanoseconds{ 0 }, metrics.max_tick);
+}
+
+TEST(DispatcherUnitTest, DispatcherMetricsAreReadableWhileRunning)
+{
+    arcana::background_dispatcher<32, arcana::park_wait_policy, arcana::dispatcher_metrics> dispatcher;
+
+    std::atomic<bool> done{ false };
+    std::thread reader{ [&] {
+        uint64_t previous = 0;
+        while (!done)
+        {
+            const auto metrics = dispatcher.metrics();
+            EXPECT_GE(metrics.items_run, previous);
+            previous = metrics.items_run;
+        }
+    } };
+
+    std::vector<arcana::task<void, std::error_code>> tasks;
+    for (int i = 0; i < 100; ++i)
+    {
+        tasks.push_back(arcana::make_task(dispatcher, arcana::cancellation::none(), []() noexcept {}));
+    }
+
+    arcana::when_all(gsl::make_span(tasks)).wait();
+    done = true;
+    reader.join();
+
+    EXPECT_EQ(100u, dispatcher.metrics().items_run);
+    EXPECT_GE(dispatcher.metrics().high_water_depth, 1u);
+}
+
+TEST(DispatcherUnitTest, QueueAndTickDoNotAllocateOnceWarm)
+{
+    arcana::manual_dispatcher<32> dispatcher;
+    int ran = 0;
+
+    auto round = [&] {
+        for (int i = 0; i < 100; ++i)
+        {
+            dispatcher.queue([&ran] { ++ran; });
+        }
+        dispatcher.tick(arcana::cancellation::none());
+    };
+
+    // the first round grows the queue and the tick's workload
+    round();
+
+    EXPECT_NO_ALLOCATIONS({
+        round();
+        round();
+    });
+
+    EXPECT_EQ(300, ran);
+}
+
+TEST(DispatcherUnitTest, QueueKeepsOrderWhileGrowing)
+{
+    arcana::manual_dispatcher<32> dispatcher;
+    std::vector<int> order;
+
+    // wrap the ring buffer around before it has to grow
+    for (int i = 0; i < 10; ++i)
+    {
+        dispatcher.queue([&order, i] { order.push_back(i); });
+    }
+    dispatcher.tick(arcana::cancellation::none());
+
+    for (int i = 10; i < 100; ++i)
+    {
+        dispatcher.queue([&order, i] { order.push_back(i); });
+    }
+    dispatcher.tick(arcana::cancellation::none());
+
+    std::vector<int> expected(100);
+    std::iota(expected.begin(), expected.end(), 0);
+    EXPECT_EQ(expected, order);
+}
+
+TEST(DispatcherUnitTest, WatchdogReportsStalledWorkOnce)
+{
+    std::mutex mutex;
+    std::vector<arcana::dispatcher_stall> stalls;
+
+    arcana::dispatcher_watchdog watchdog{ std::chrono::milliseconds{ 20 }, [&](const arcana::dispatcher_stall& stall) {
+        std::lock_guard<std::mutex> guard{ mutex };
+        stalls.push_back(stall);
+    } };
+
+    arcana::background_dispatcher<32, arcana::park_wait_policy, arcana::no_dispatcher_metrics, arcana::dispatcher_tracking> dispatcher;
+    auto watched = watchdog.watch(dispatcher, "loader");
+
+    std::promise<void> done;
+    dispatcher.queue("quick", [] {});
+    dispatcher.queue("blocking", [] { std::this_thread::sleep_for(std::chrono::milliseconds{ 150 }); });
+    dispatcher.queue([&done] { done.set_value(); });
+    done.get_future().wait();
+
+    // give the watchdog a few more samples to make sure it doesn't report it twice
+    std::this_thread::sleep_for(std::chrono::milliseconds{ 50 });
+
+    std::lock_guard<std::mutex> guard{ mutex };
+    ASSERT_EQ(1u, stalls.size());
+    EXPECT_STREQ("loader", stalls[0].dispatcher);
+    EXPECT_STREQ("blocking", stalls[0].work);
+    EXPECT_GE(stalls[0].elapsed, std::chrono::milliseconds{ 20 });
+}
+
+TEST(DispatcherUnitTest, WatchdogIgnoresWorkUnderThreshold)
+{
+    std::atomic<int> stalls{ 0 };
+    arcana::dispatcher_watchdog watchdog{ std::chrono::milliseconds{ 200 }, [&](const arcana::dispatcher_stall&) { stalls++; } };
+
+    arcana::manual_dispatcher<32, arcana::park_wait_policy, arcana::no_dispatcher_metrics, arcana::dispatcher_tracking> dispatcher;
+    auto watched = watchdog.watch(dispatcher, "manual");
+
+    const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds{ 100 };
+    while (std::chrono::steady_clock::now() < end)
+    {
+        dispatcher.queue("short", [] { std::this_thread::sleep_for(std::chrono::milliseconds{ 1 }); });
+        dispatcher.tick(arcana::cancellation::none());
+    }
+
+    EXPECT_EQ(0, stalls);
+}
+
+TEST(DispatcherUnitTest, WatchdogHoldsAnnotationsUntilTheStallEnds)
+{
+    std::atomic<int> annotations{ 0 };
+    std::shared_ptr<int> annotation = std::make_shared<int>(0);
+    std::weak_ptr<int> held = annotation;
+
+    arcana::dispatcher_watchdog watchdog{ std::chrono::milliseconds{ 20 }, [](const arcana::dispatcher_stall&) {},
+        [&](const arcana::dispatcher_stall& stall) -> std::shared_ptr<void> {
+            EXPECT_STREQ("blocking", stall.work);
+            annotations++;
+            return std::move(annotation);
+        } };
+
+    arcana::manual_dispatcher<32, arcana::park_wait_policy, arcana::no_dispatcher_metrics, arcana::dispatcher_tracking> dispatcher;
+    auto watched = watchdog.watch(dispatcher, "manual");
+
+    dispatcher.queue("blocking", [&] {
+        while (annotations == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+        }
+        EXPECT_FALSE(held.expired());
+    });
+    dispatcher.tick(arcana::cancellation::none());
+
+    // the annotation is released the next time the watchdog sees the dispatcher idle
+    const auto end = std::chrono::steady_clock::now() + std::chrono::seconds{ 5 };
+    while (!held.expired() && std::chrono::steady_clock::now() < end)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+    }
+
+    EXPECT_EQ(1, annotations);
+    EXPECT_TRUE(held.expired());
+}
@@ -0,0 +1,228 @@
+#include <gtest/gtest.h>
+
+#include <arcana/threading/dispatcher.h>
+#include <arcana/threading/task.h>
+#include <arcana/threading/task_hooks.h>
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef ARCANA_TASK_HOOKS
+#error "the task hooks tests need ARCANA_TASK_HOOKS"
+#endif
+
+namespace
+{
+    struct recording_sink : arcana::task_hooks::sink
+    {
+        struct event
+        {
+            std::string step;
+            arcana::task_hooks::task_record record;
+        };
+
+        void on_created(const arcana::task_hooks::task_record& record) override { add("created", record); }
+        void on_scheduled(const arcana::task_hooks::task_record& record) override { add("scheduled", record); }
+        void on_started(const arcana::task_hooks::task_record& record) override { add("started", record); }
+        void on_completed(const arcana::task_hooks::task_record& record) override { add("completed", record); }
+
+        std::vector<std::string> steps(uint64_t id)
+        {
+            std::lock_guard<std::mutex> guard{ mutex };
+
+            std::vector<std::string> result;
+            for (auto& e : events)
+            {
+                if (e.record.id == id)
+                    result.push_back(e.step);
+            }
+            return result;
+        }
+
+        std::vector<event> named(const char* name)
+        {
+            std::lock_guard<std::mutex> guard{ mutex };
+
+            std::vector<event> result;
+            for (auto& e : events)
+            {
+                if (e.record.name != nullptr && std::string{ e.record.name } == name)
+                    result.push_back(e);
+            }
+            return result;
+        }
+
+        void add(const char* step, const arcana::task_hooks::task_record& record)
+        {
+            std::lock_guard<std::mutex> guard{ mutex };
+            events.push_back({ step, record });
+        }
+
+        std::mutex mutex;
+        std::vector<event> events;
+    };
+
+    struct sink_scope
+    {
+        explicit sink_scope(arcana::task_hooks::sink& sink)
+        {
+            arcana::task_hooks::set_sink(&sink);
+        }
+
+        ~sink_scope()
+        {
+            arcana::task_hooks::set_sink(nullptr);
+        }
+    };
+}
+
+TEST(TaskHooksUnitTest, TaskGoesThroughEveryStepInOrder)
+{
+    recording_sink sink;
+    sink_scope scope{ sink };
+
+    arcana::manual_dispatcher<32> dispatcher;
+
+    {
+        arcana::task_hooks::name_scope name{ "work" };
+
+        arcana::make_task(dispatcher, arcana::cancellation::none(), [] {})
+            .then(dispatcher, arcana::cancellation::none(), [] {});
+    }
+
+    while (dispatcher.tick(arcana::cancellation::none())) {}
+
+    auto events = sink.named("work");
+    ASSERT_FALSE(events.empty());
+
+    const uint64_t task = events.front().record.id;
+    EXPECT_EQ((std::vector<std::string>{ "created", "scheduled", "started", "completed" }), sink.steps(task));
+
+    // the continuation was created in the same scope, and gets scheduled once its parent completes
+    uint64_t continuation = 0;
+    for (auto& e : events)
+    {
+        if (e.record.id != task)
+            continuation = e.record.id;
+    }
+    ASSERT_NE(0u, continuation);
+    EXPECT_EQ((std::vector<std::string>{ "created", "scheduled", "started", "completed" }), sink.steps(continuation));
+
+    const auto& last = events.back().record;
+    EXPECT_EQ(continuation, last.id);
+    EXPECT_LE(last.created, last.scheduled);
+    EXPECT_LE(last.scheduled, last.started);
+    EXPECT_LE(last.started, last.completed);
+}
+
+TEST(TaskHooksUnitTest, CompletionSourcesAreOnlyCreatedAndCompleted)
+{
+    recording_sink sink;
+    sink_scope scope{ sink };
+
+    arcana::task_hooks::name_scope name{ "source" };
+
+    arcana::task_completion_source<void, std::error_code> source;
+    source.complete();
+
+    auto events = sink.named("source");
+    ASSERT_EQ(2u, events.size());
+    EXPECT_EQ("created", events[0].step);
+    EXPECT_EQ("completed", events[1].step);
+    EXPECT_EQ(arcana::task_hooks::clock::time_point{}, events[1].record.started);
+}
+
+TEST(TaskHooksUnitTest, InlineContinuationsOfCompletedTasksAreReported)
+{
+    recording_sink sink;
+    sink_scope scope{ sink };
+
+    auto ready = arcana::task_from_result<std::error_code>(1);
+
+    {
+        arcana::task_hooks::name_scope name{ "inline" };
+        ready.then(arcana::inline_scheduler, arcana::cancellation::none(), [](int value) noexcept { return value + 1; });
+    }
+
+    auto events = sink.named("inline");
+    ASSERT_FALSE(events.empty());
+    EXPECT_EQ((std::vector<std::string>{ "created", "scheduled", "started", "completed" }), sink.steps(events.front().record.id));
+}
+
+TEST(TaskHooksUnitTest, NothingIsReportedWithoutSink)
+{
+    recording_sink sink;
+
+    arcana::manual_dispatcher<32> dispatcher;
+    arcana::make_task(dispatcher, arcana::cancellation::none(), [] {});
+
+    sink_scope scope{ sink };
+    while (dispatcher.tick(arcana::cancellation::none())) {}
+
+    // steps that happened while no sink was installed don't get a timestamp
+    ASSERT_EQ(2u, sink.events.size());
+    EXPECT_EQ(arcana::task_hooks::clock::time_point{}, sink.events[1].record.created);
+    EXPECT_EQ(arcana::task_hooks::clock::time_point{}, sink.events[1].record.scheduled);
+    EXPECT_NE(arcana::task_hooks::clock::time_point{}, sink.events[1].record.completed);
+}
+
+TEST(TaskHooksUnitTest, LatencySinkAggregatesPerName)
+{
+    arcana::task_hooks::latency_histogram_sink sink;
+    sink_scope scope{ sink };
+
+    arcana::manual_dispatcher<32> dispatcher;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        arcana::task_hooks::name_scope name{ "sleepy" };
+        arcana::make_task(dispatcher, arcana::cancellation::none(), [] {
+            std::this_thread::sleep_for(std::chrono::milliseconds{ 2 });
+        });
+    }
+
+    {
+        arcana::task_hooks::name_scope name{ "quick" };
+        arcana::make_task(dispatcher, arcana::cancellation::none(), [] {});
+    }
+
+    // unnamed tasks aren't aggregated
+    arcana::make_task(dispatcher, arcana::cancellation::none(), [] {});
+
+    while (dispatcher.tick(arcana::cancellation::none())) {}
+
+    auto latencies = sink.snapshot();
+    ASSERT_EQ(2u, latencies.size());
+
+    EXPECT_EQ(3u, latencies["sleepy"].wait.count());
+    EXPECT_EQ(3u, latencies["sleepy"].run.count());
+    EXPECT_GE(latencies["sleepy"].run.total(), std::chrono::milliseconds{ 6 });
+    EXPECT_GE(latencies["sleepy"].run.percentile(0.5), std::chrono::milliseconds{ 2 });
+
+    EXPECT_EQ(1u, latencies["quick"].run.count());
+
+    sink.reset();
+    EXPECT_TRUE(sink.snapshot().empty());
+}
+
+TEST(TaskHooksUnitTest, HistogramPercentiles)
+{
+    arcana::task_hooks::latency_histogram histogram;
+    EXPECT_EQ(std::chrono::nanoseconds{ 0 }, histogram.percentile(0.5));
+
+    for (int i = 0; i < 99; ++i)
+    {
+        histogram.record(std::chrono::nanoseconds{ 100 });
+    }
+    histogram.record(std::chrono::microseconds{ 10 });
+
+    EXPECT_EQ(100u, histogram.count());
+    EXPECT_EQ(std::chrono::microseconds{ 10 }, histogram.max());
+    EXPECT_EQ(1u, histogram.buckets()[13]);
+
+    // 100ns lands in the [64, 128) bucket
+    EXPECT_EQ(std::chrono::nanoseconds{ 127 }, histogram.percentile(0.5));
+    EXPECT_EQ(std::chrono::microseconds{ 10 }, histogram.percentile(1.0));
+}
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include "AllocationCounter.h"
+
 #include <arcana/threading/dispatcher.h>
 
 #include <arcana/threading/task.h>
@@ -444,6 +446,171 @@ TEST(TaskUnitTest, FromResult)
     EXPECT_EQ("ABC", result);
 }
 
+TEST(TaskUnitTest, ReadyTaskRunsInlineContinuationImmediately)
+{
+    arcana::cancellation_source cancel;
+
+    int result = 0;
+    auto task = arcana::task_from_result<std::error_code>(10).then(arcana::inline_scheduler, arcana::cancellation::none(), [](int value) noexcept
+    {
+        return value + 1;
+    });
+
+    task.then(arcana::inline_scheduler, arcana::cancellation::none(), [&](int value) noexcept
+    {
+        result = value;
+    });
+
+    EXPECT_EQ(11, result);
+
+    arcana::manual_dispatcher<32> dis;
+
+    int queued = 0;
+    task.then(dis, arcana::cancellation::none(), [&](int value) noexcept
+    {
+        queued = value;
+    });
+
+    EXPECT_EQ(0, queued);
+    while (dis.tick(cancel)) {};
+    EXPECT_EQ(11, queued);
+}
+
+TEST(TaskUnitTest, ReadyTaskPropagatesErrorsAndCancellation)
+{
+    bool ran = false;
+    arcana::expected<int, std::error_code> result{ 0 };
+
+    arcana::task_from_error<int>(std::errc::invalid_argument).then(arcana::inline_scheduler, arcana::cancellation::none(), [&](int value) noexcept
+    {
+        ran = true;
+        return value;
+    }).then(arcana::inline_scheduler, arcana::cancellation::none(), [&](const arcana::expected<int, std::error_code>& value) noexcept
+    {
+        result = value;
+    });
+
+    EXPECT_FALSE(ran);
+    EXPECT_TRUE(result.has_error());
+    EXPECT_TRUE(result.error() == std::errc::invalid_argument);
+
+    arcana::cancellation_source cancel;
+    cancel.cancel();
+
+    arcana::task_from_result<std::error_code>().then(arcana::inline_scheduler, cancel, [&]() noexcept
+    {
+        ran = true;
+    }).then(arcana::inline_scheduler, arcana::cancellation::none(), [&](const arcana::expected<void, std::error_code>& value) noexcept
+    {
+        EXPECT_TRUE(value.error() == std::errc::operation_canceled);
+    });
+
+    EXPECT_FALSE(ran);
+}
+
+TEST(TaskUnitTest, ReadyTaskUnwrapsReturnedTask)
+{
+    arcana::cancellation_source cancel;
+    arcana::manual_dispatcher<32> dis;
+
+    std::string result;
+
+    arcana::task_from_result<std::error_code>(2).then(arcana::inline_scheduler, arcana::cancellation::none(), [&](int value) noexcept
+    {
+        return arcana::make_task(dis, arcana::cancellation::none(), [value]() noexcept
+        {
+            return std::to_string(value * 21);
+        });
+    }).then(arcana::inline_scheduler, arcana::cancellation::none(), [&](const std::string& value) noexcept
+    {
+        result = value;
+    });
+
+    EXPECT_EQ("", result);
+    while (dis.tick(cancel)) {};
+    EXPECT_EQ("42", result);
+}
+
+TEST(TaskUnitTest, WaitAndGetFromOtherThread)
+{
+    arcana::background_dispatcher<32> background;
+
+    std::promise<void> gate;
+    auto task = arcana::make_task(background, arcana::cancellation::none(), [future = gate.get_future().share()]() noexcept
+    {
+        future.wait();
+        return 42;
+    });
+
+    EXPECT_FALSE(task.wait_for(std::chrono::milliseconds{ 10 }));
+
+    gate.set_value();
+
+    task.wait();
+    EXPECT_TRUE(task.wait_for(std::chrono::milliseconds{ 0 }));
+    EXPECT_EQ(42, task.get().value());
+}
+
+TEST(TaskUnitTest, GetFollowsUnwrappedTasks)
+{
+    arcana::background_dispatcher<32> background;
+
+    auto task = arcana::make_task(background, arcana::cancellation::none(), [&background]() noexcept
+    {
+        return arcana::make_task(background, arcana::cancellation::none(), []() noexcept
+        {
+            return std::string{ "unwrapped" };
+        });
+    });
+
+    EXPECT_EQ("unwrapped", task.get().value());
+    EXPECT_EQ(42, arcana::task_from_result<std::error_code>(42).get().value());
+    EXPECT_TRUE(arcana::task_from_error<int>(std::errc::invalid_argument).get().has_error());
+}
+
+TEST(TaskUnitTest, WaitRunsDispatcherWork)
+{
+    arcana::manual_dispatcher<32> dispatcher;
+
+    int steps = 0;
+    auto task = arcana::make_task(dispatcher, arcana::cancellation::none(), [&]() noexcept
+    {
+        steps++;
+    }).then(dispatcher, arcana::cancellation::none(), [&]() noexcept
+    {
+        steps++;
+    });
+
+    task.wait(dispatcher);
+
+    EXPECT_EQ(2, steps);
+}
+
+TEST(TaskUnitTest, ReadyTasksKeepTheirIdentity)
+{
+    auto first = arcana::task_from_result<std::error_code>(1);
+    auto second = arcana::task_from_result<std::error_code>(1);
+    auto copy = first;
+
+    EXPECT_FALSE(first == second);
+    EXPECT_TRUE(first == copy);
+    EXPECT_EQ(sizeof(std::shared_ptr<void>), sizeof(first));
+}
+
+// ready void tasks only share a payload in uninstrumented builds
+#ifndef ARCANA_TASK_HOOKS
+TEST(TaskUnitTest, ReadyVoidTasksShareTheirPayload)
+{
+    auto first = arcana::task_from_result<std::error_code>();
+    auto second = arcana::task_from_result<std::error_code>();
+    auto failed = arcana::task_from_error<void>(std::errc::invalid_argument);
+
+    EXPECT_TRUE(first == second);
+    EXPECT_FALSE(first == failed);
+    EXPECT_TRUE(failed.get().has_error());
+}
+#endif
+
 TEST(TaskUnitTest, TaskReturningTask)
 {
     arcana::cancellation_source cancel;
@@ -691,6 +858,78 @@ TEST(TaskUnitTest, PendingTaskScopeBubbleError)
     EXPECT_TRUE(taskComplete);
 }
 
+TEST(TaskUnitTest, PendingTaskScopeAdmitDefersWorkUntilASlotFrees)
+{
+    arcana::pending_task_scope<std::error_code> scope{ 2 };
+
+    std::vector<arcana::task_completion_source<void, std::error_code>> work(3);
+    int started = 0;
+
+    for (auto& source : work)
+    {
+        scope.admit([&]() noexcept
+        {
+            started++;
+            return source.as_task();
+        });
+    }
+
+    EXPECT_EQ(2, started);
+
+    work[1].complete();
+    EXPECT_EQ(3, started);
+
+    bool done = false;
+    scope.when_all().then(arcana::inline_scheduler, arcana::cancellation::none(), [&](const arcana::expected<void, std::error_code>& result) noexcept
+    {
+        EXPECT_TRUE(result.has_error());
+        done = true;
+    });
+
+    work[0].complete();
+    EXPECT_FALSE(done);
+
+    work[2].complete(arcana::make_unexpected(std::make_error_code(std::errc::io_error)));
+    EXPECT_TRUE(done);
+    EXPECT_TRUE(scope.completed());
+    EXPECT_TRUE(scope.has_error());
+}
+
+TEST(TaskUnitTest, PendingTaskScopeAdmitLimitsConcurrency)
+{
+    constexpr size_t limit = 3;
+    arcana::pending_task_scope<std::error_code> scope{ limit };
+    arcana::background_dispatcher<32> workers[4];
+
+    std::atomic<size_t> running{ 0 };
+    std::atomic<size_t> peak{ 0 };
+    std::atomic<int> ran{ 0 };
+
+    for (int i = 0; i < 200; ++i)
+    {
+        scope.admit([&, i]() noexcept
+        {
+            return arcana::make_task(workers[i % 4], arcana::cancellation::none(), [&]() noexcept
+            {
+                size_t now = ++running;
+                size_t seen = peak;
+                while (now > seen && !peak.compare_exchange_weak(seen, now)) {}
+
+                std::this_thread::yield();
+
+                --running;
+                ++ran;
+            });
+        });
+    }
+
+    scope.when_all().wait();
+
+    EXPECT_EQ(200, ran.load());
+    EXPECT_LE(peak.load(), limit);
+    EXPECT_FALSE(scope.has_error());
+}
+
 TEST(TaskUnitTest, LastMethodAlwaysRuns)
 {
     arcana::cancellation_source cancel;
@@ -1485,6 +1724,77 @@ TEST(TaskUnitTest, LargeNestedSetOfStasks)
     EXPECT_TRUE(completed);
 }
 
+TEST(TaskUnitTest, DeepInlineChainDoesNotOverflowStack)
+{
+    constexpr int chainLength = 100000;
+
+    arcana::task_completion_source<void, std::error_code> signal{};
+
+    int steps = 0;
+
+    arcana::task<void, std::error_code> parent = signal.as_task();
+    for (int i = 0; i < chainLength; ++i)
+    {
+        parent = parent.then(arcana::inline_scheduler, arcana::cancellation::none(), [&steps]() noexcept
+        {
+            steps++;
+        });
+    }
+
+    bool completed = false;
+    parent.then(arcana::inline_scheduler, arcana::cancellation::none(), [&]() noexcept
+    {
+        completed = true;
+    });
+
+    signal.complete();
+
+    EXPECT_EQ(chainLength, steps);
+    EXPECT_TRUE(completed);
+}
+
+TEST(TaskUnitTest, DeepInlineChainKeepsOrder)
+{
+    arcana::task_completion_source<void, std::error_code> signal{};
+
+    std::vector<int> order;
+
+    arcana::task<void, std::error_code> parent = signal.as_task();
+    for (int i = 0; i < 1000; ++i)
+    {
+        parent = parent.then(arcana::inline_scheduler, arcana::cancellation::none(), [&order, i]() noexcept
+        {
+            order.push_back(i);
+        });
+    }
+
+    signal.complete();
+
+    std::vector<int> expected(1000);
+    std::iota(expected.begin(), expected.end(), 0);
+    EXPECT_EQ(expected, order);
+}
+
+arcana::task<void, std::error_code> ReadyChainStep(int remaining, int& steps)
+{
+    return arcana::task_from_result<std::error_code>().then(arcana::inline_scheduler, arcana::cancellation::none(), [remaining, &steps]() noexcept
+    {
+        steps++;
+        return remaining == 0 ? arcana::task_from_result<std::error_code>() : ReadyChainStep(remaining - 1, steps);
+    });
+}
+
+TEST(TaskUnitTest, DeepReadyChainDoesNotOverflowStack)
+{
+    constexpr int chainLength = 100000;
+
+    int steps = 0;
+    auto task = ReadyChainStep(chainLength, steps);
+
+    EXPECT_TRUE(task.wait_for(std::chrono::seconds{ 0 }));
+    EXPECT_EQ(chainLength + 1, steps);
+}
+
 // This test validates that continuations are properly
 // reparented when unwrapped. When not properly reparented,
 // parents would get destroyed because they were old
@@ -1570,6 +1880,60 @@ TEST(TaskUnitTest, GenerateLotsOfTasksRecursively)
     EXPECT_TRUE_(result.error() == std::errc::operation_canceled, "The result should have completed through cancellation");
 }
 
+static arcana::task<int, std::error_code> CountDownAsync(arcana::manual_dispatcher<32>& background, int remaining)
+{
+    return arcana::make_task(background, arcana::cancellation::none(), [&background, remaining]() noexcept
+    {
+        if (remaining == 0)
+        {
+            return arcana::task_from_result<std::error_code>(42);
+        }
+
+        return CountDownAsync(background, remaining - 1);
+    });
+}
+
+TEST(TaskUnitTest, ContinuationsOnLongRedirectChain)
+{
+    arcana::manual_dispatcher<32> background;
+
+    auto first = CountDownAsync(background, 1000);
+
+    int early = 0;
+    first.then(arcana::inline_scheduler, arcana::cancellation::none(), [&](int value) noexcept
+    {
+        early = value;
+    });
+
+    // unwrap part of the chain, then attach to the stand-in twice
+    // so the second attach walks the compressed chain
+    for (int i = 0; i < 500; ++i)
+    {
+        background.tick(arcana::cancellation::none());
+    }
+
+    int middle = 0;
+    for (int i = 0; i < 2; ++i)
+    {
+        first.then(arcana::inline_scheduler, arcana::cancellation::none(), [&](int value) noexcept
+        {
+            middle += value;
+        });
+    }
+
+    while (background.tick(arcana::cancellation::none())) {};
+
+    int late = 0;
+    first.then(arcana::inline_scheduler, arcana::cancellation::none(), [&](int value) noexcept
+    {
+        late = value;
+    });
+
+    EXPECT_EQ(42, early);
+    EXPECT_EQ(84, middle);
+    EXPECT_EQ(42, late);
+}
+
 TEST(TaskUnitTest, NestedTaskChain)
 {
     auto task = CreateNestedTaskChain(1);
@@ -1861,3 +2225,48 @@ TEST(TaskUnitTest, CancellationFromTaskBody)
     }
     });
 }
+
+TEST(TaskUnitTest, ReadyTasksWithInlineContinuationsAllocateOnlyTheirPayloads)
+{
+    EXPECT_ALLOCATIONS(3, {
+        auto task = arcana::task_from_result<std::error_code>(1)
+            .then(arcana::inline_scheduler, arcana::cancellation::none(), [](int value) noexcept { return value + 1; })
+            .then(arcana::inline_scheduler, arcana::cancellation::none(), [](int value) noexcept { return value * 2; });
+
+        EXPECT_EQ(4, task.get().value());
+    });
+}
+
+// instrumented builds allocate payloads for ready tasks and their inline continuations
+#ifndef ARCANA_TASK_HOOKS
+TEST(TaskUnitTest, ReadyVoidTasksDontAllocate)
+{
+    // the first one allocates the payload they all share
+    arcana::task_from_result<std::error_code>();
+
+    EXPECT_NO_ALLOCATIONS({
+        auto task = arcana::task_from_result<std::error_code>()
+            .then(arcana::inline_scheduler, arcana::cancellation::none(), []() noexcept {})
+            .then(arcana::inline_scheduler, arcana::cancellation::none(), []() noexcept {});
+
+        EXPECT_FALSE(task.get().has_error());
+    });
+}
+#endif
+
+TEST(TaskUnitTest, MakeTaskAllocatesOnlyItsPayload)
+{
+    arcana::manual_dispatcher<32> dispatcher;
+
+    // let the dispatcher's queue grow first
+    arcana::make_task(dispatcher, arcana::cancellation::none(), []() noexcept {});
+    dispatcher.tick(arcana::cancellation::none());
+
+    arcana::task<int, std::error_code> task;
+    EXPECT_ALLOCATIONS(1, {
+        task = arcana::make_task(dispatcher, arcana::cancellation::none(), []() noexcept { return 42; });
+    });
+
+    EXPECT_NO_ALLOCATIONS({ dispatcher.tick(arcana::cancellation::none()); });
+    EXPECT_EQ(42, task.get().value());
+}
@@ -0,0 +1,262 @@
+#pragma once
+
+#include "router.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace arcana
+{
+    namespace internal
+    {
+        //
+        // Holds a shared_ptr that can be read and replaced from any thread.
+        //
+        template<typename T>
+        class shared_snapshot
+        {
+        public:
+            std::shared_ptr<const T> load() const
+            {
+#ifdef __cpp_lib_atomic_shared_ptr
+                return m_value.load(std::memory_order_acquire);
+#else
+                std::lock_guard<std::mutex> guard{ m_mutex };
+                return m_value;
+#endif
+            }
+
+            void store(std::shared_ptr<const T> value)
+            {
+#ifdef __cpp_lib_atomic_shared_ptr
+                m_value.store(std::move(value), std::memory_order_release);
+#else
+                // swap so that the previous value gets released outside of the lock
+                std::lock_guard<std::mutex> guard{ m_mutex };
+                m_value.swap(value);
+#endif
+            }
+
+        private:
+#ifdef __cpp_lib_atomic_shared_ptr
+            std::atomic<std::shared_ptr<const T>> m_value;
+#else
+            mutable std::mutex m_mutex;
+            std::shared_ptr<const T> m_value;
+#endif
+        };
+    }
+
+    /*
+        A router that listeners can be added to and events fired through from any thread, concurrently.
+
+        Each event type has an immutable snapshot of its listeners that fires take a reference to and
+        iterate without any lock. Adding or removing a listener copies the snapshot, changes the copy
+        and publishes it for the fires that start after that, so it's meant for listeners that change
+        rarely compared to how often events get fired. Old snapshots get released by the last fire
+        that was using them, along with the listeners that were removed from them.
+
+        Releasing a ticket waits for the fires that could still call its listener, the ones that
+        started before the listener got removed, so whatever the listener captured can be destroyed
+        right after. Tickets therefore can't be released while holding a lock that listeners take.
+        The only exception is releasing a ticket from a listener of the same router, which can't
+        wait on the fire it's running in and returns right away. Listeners also get called
+        concurrently when events get fired from multiple threads, so they have to be thread safe.
+    */
+    template<typename... EventTs>
+    class concurrent_router
+    {
+    public:
+        static constexpr size_t LISTENER_SIZE = router<EventTs...>::LISTENER_SIZE;
+
+        template<typename EventT>
+        using listener_function = typename router<EventTs...>::template listener_function<EventT>;
+
+        concurrent_router() = default;
+        concurrent_router(const concurrent_router&) = delete;
+        concurrent_router& operator=(const concurrent_router&) = delete;
+
+        /*
+            Sends an event synchronously to all listeners, from the calling thread.
+        */
+        template<typename EventT>
+        void fire(const EventT& evt) const
+        {
+            using event = std::decay_t<EventT>;
+
+            const auto listeners = std::get<listener_group<event>>(m_listeners).load();
+            if (listeners == nullptr)
+                return;
+
+            const firing scope{ *this };
+
+            for (const listener<event>& listener : *listeners)
+            {
+                listener.callback(evt);
+            }
+        }
+
+        /*
+            Adds an event listener.
+        */
+        template<typename EventT, typename T>
+        ticket add_listener(T&& callback)
+        {
+            using event = std::decay_t<EventT>;
+
+            // declared ahead of the lock so that the previous snapshot gets released outside of it
+            snapshot_t<event> current;
+
+            std::lock_guard<std::mutex> guard{ m_mutex };
+
+            auto& group = std::get<listener_group<event>>(m_listeners);
+            current = group.load();
+
+            auto updated = std::make_shared<std::vector<listener<event>>>();
+            updated->reserve((current ? current->size() : 0) + 1);
+            if (current)
+            {
+                updated->assign(current->begin(), current->end());
+            }
+
+            const ticket_seed id = m_nextId++;
+            updated->push_back({ listener_function<event>{ std::forward<T>(callback) }, id });
+
+            group.store(std::move(updated));
+            retire<event>(current);
+
+            return ticket{ [id, this] { remove_listener<event>(id); } };
+        }
+
+    private:
+        template<typename EventT>
+        struct listener
+        {
+            listener_function<EventT> callback;
+            ticket_seed id;
+        };
+
+        template<typename EventT>
+        using snapshot_t = std::shared_ptr<const std::vector<listener<EventT>>>;
+
+        template<typename EventT>
+        using listener_group = internal::shared_snapshot<std::vector<listener<EventT>>>;
+
+        template<typename EventT>
+        using retired_snapshots = std::vector<std::weak_ptr<const std::vector<listener<EventT>>>>;
+
+        //
+        // The fires running on a thread form a stack, for any number of routers.
+        //
+        class firing
+        {
+        public:
+            explicit firing(const concurrent_router& router)
+                : m_router{ router }
+                , m_outer{ std::exchange(innermost(), this) }
+            {}
+
+            firing(const firing&) = delete;
+            firing& operator=(const firing&) = delete;
+
+            ~firing()
+            {
+                innermost() = m_outer;
+            }
+
+            static bool running(const concurrent_router& router)
+            {
+                for (const firing* scope = innermost(); scope != nullptr; scope = scope->m_outer)
+                {
+                    if (&scope->m_router == &router)
+                        return true;
+                }
+
+                return false;
+            }
+
+        private:
+            static firing*& innermost()
+            {
+                thread_local firing* scope = nullptr;
+                return scope;
+            }
+
+            const concurrent_router& m_router;
+            firing* m_outer;
+        };
+
+        // must be called with the lock held
+        template<typename EventT>
+        void retire(const snapshot_t<EventT>& snapshot)
+        {
+            if (snapshot == nullptr)
+                return;
+
+            auto& retired = std::get<retired_snapshots<EventT>>(m_retired);
+            retired.erase(std::remove_if(retired.begin(), retired.end(), [](const auto& weak) { return weak.expired(); }), retired.end());
+            retired.emplace_back(snapshot);
+        }
+
+        template<typename EventT>
+        void remove_listener(ticket_seed id)
+        {
+            snapshot_t<EventT> current;
+            retired_snapshots<EventT> draining;
+
+            {
+                std::lock_guard<std::mutex> guard{ m_mutex };
+
+                auto& group = std::get<listener_group<EventT>>(m_listeners);
+                current = group.load();
+
+                auto updated = std::make_shared<std::vector<listener<EventT>>>();
+                updated->reserve(current->size() - 1);
+                std::copy_if(current->begin(), current->end(), std::back_inserter(*updated), [id](const listener<EventT>& listener) {
+                    return listener.id != id;
+                });
+
+                assert(updated->size() + 1 == current->size() && "removing item that isn't there");
+
+                group.store(std::move(updated));
+                retire<EventT>(current);
+
+                // every fire that could still call the removed listener holds one of these
+                draining = std::get<retired_snapshots<EventT>>(m_retired);
+            }
+
+            // current might be the last reference to the previous snapshot, which
+            // releases the removed listener, let it go outside of the lock
+            current.reset();
+
+            if (firing::running(*this))
+                return;
+
+            // fires are expected to be short, and removing listeners to be rare
+            for (const auto& snapshot : draining)
+            {
+                while (!snapshot.expired())
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        std::tuple<listener_group<EventTs>...> m_listeners;
+
+        // snapshots replaced by changes to the listeners, which fires might still be using
+        std::tuple<retired_snapshots<EventTs>...> m_retired;
+
+        // serializes the changes to the listeners
+        std::mutex m_mutex;
+        ticket_seed m_nextId = 0;
+    };
+}
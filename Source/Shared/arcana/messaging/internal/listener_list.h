@@ -0,0 +1,243 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <gsl/gsl>
+
+namespace arcana { namespace internal {
+
+    //
+    // Listener storage for the router, a generational slot map over a vector of listeners
+    // kept in the order they were added.
+    //
+    // Ids pack a slot index in the low 32 bits and the generation of that slot in the high ones.
+    // Slots point at the listener's position in the vector, which makes removal O(1): it bumps the
+    // slot's generation so stale ids get rejected, puts the slot on the free list for the next
+    // listener to reuse and turns the listener into a tombstone. Tombstones get skipped when firing
+    // and compacted away, in place, once they make up half of the list.
+    //
+    // Listeners can be added and removed while firing, including from nested fires. Listeners added
+    // while firing only get called by the fires that start after the outermost one is done. They go
+    // straight to the end of the vector unless that would make it reallocate, which would move the
+    // callbacks that are running, in which case they wait in a side vector until the fire is done.
+    //
+    template<typename CallbackT>
+    class listener_list
+    {
+    public:
+        using id_t = uint64_t;
+
+        template<typename T>
+        id_t add(T&& callback)
+        {
+            uint32_t slot;
+            if (m_freeSlot != no_slot)
+            {
+                slot = m_freeSlot;
+                m_freeSlot = m_slots[slot].position;
+            }
+            else
+            {
+                slot = gsl::narrow_cast<uint32_t>(m_slots.size());
+                m_slots.push_back({ 0, 0 });
+            }
+
+            if (m_firing == 0 || m_entries.size() < m_entries.capacity())
+            {
+                m_slots[slot].position = gsl::narrow_cast<uint32_t>(m_entries.size());
+                m_entries.push_back({ CallbackT{ std::forward<T>(callback) }, slot, true });
+
+                if (m_firing == 0)
+                {
+                    m_visible = m_entries.size();
+                }
+            }
+            else
+            {
+                m_slots[slot].position = deferred_bit | gsl::narrow_cast<uint32_t>(m_deferred.size());
+                m_deferred.push_back({ CallbackT{ std::forward<T>(callback) }, slot, true });
+            }
+
+            return (static_cast<id_t>(m_slots[slot].generation) << 32) | slot;
+        }
+
+        //
+        // Removes the listener, returns false if the id doesn't refer to a listener in the list.
+        //
+        bool remove(id_t id)
+        {
+            const auto slot = static_cast<uint32_t>(id);
+            if (slot >= m_slots.size() || m_slots[slot].generation != static_cast<uint32_t>(id >> 32))
+            {
+                return false;
+            }
+
+            auto& location = m_slots[slot];
+            entry& removed = (location.position & deferred_bit) != 0
+                ? m_deferred[location.position & ~deferred_bit]
+                : m_entries[location.position];
+
+            removed.valid = false;
+            ++m_tombstones;
+
+            location.generation++;
+            location.position = m_freeSlot;
+            m_freeSlot = slot;
+
+            if (m_firing != 0)
+            {
+                // the listener might be the one that's running, release it once the fire is done
+                m_released = true;
+            }
+            else
+            {
+                removed.callback = CallbackT{};
+
+                if (m_tombstones * 2 > m_entries.size())
+                {
+                    compact();
+                }
+            }
+
+            return true;
+        }
+
+        template<typename... ArgTs>
+        void fire(const ArgTs&... args)
+        {
+            // listeners added from here on are left out of this fire
+            const size_t count = m_visible;
+            if (count == 0)
+            {
+                return;
+            }
+
+            ++m_firing;
+
+            try
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    // indexing on purpose, the vector doesn't reallocate while firing
+                    // but listeners can get added and removed by the callbacks
+                    entry& current = m_entries[i];
+                    if (current.valid)
+                    {
+                        current.callback(args...);
+                    }
+                }
+            }
+            catch (...)
+            {
+                if (--m_firing == 0)
+                {
+                    settle();
+                }
+                throw;
+            }
+
+            if (--m_firing == 0)
+            {
+                settle();
+            }
+        }
+
+        size_t size() const
+        {
+            return m_entries.size() + m_deferred.size() - m_tombstones;
+        }
+
+        bool firing() const
+        {
+            return m_firing != 0;
+        }
+
+    private:
+        static constexpr uint32_t no_slot = std::numeric_limits<uint32_t>::max();
+        static constexpr uint32_t deferred_bit = uint32_t{ 1 } << 31;
+
+        struct entry
+        {
+            CallbackT callback;
+            uint32_t slot;
+            bool valid;
+        };
+
+        struct slot_location
+        {
+            uint32_t generation;
+
+            // position of the listener in m_entries, in m_deferred if deferred_bit is set,
+            // or the next free slot when the slot is free
+            uint32_t position;
+        };
+
+        //
+        // Brings in the listeners that were added while firing and drops the ones removed while firing.
+        //
+        void settle()
+        {
+            for (entry& added : m_deferred)
+            {
+                if (added.valid)
+                {
+                    m_slots[added.slot].position = gsl::narrow_cast<uint32_t>(m_entries.size());
+                    m_entries.push_back(std::move(added));
+                }
+                else
+                {
+                    --m_tombstones;
+                }
+            }
+            m_deferred.clear();
+
+            m_visible = m_entries.size();
+
+            if (m_released)
+            {
+                compact();
+            }
+        }
+
+        //
+        // Removes the tombstones, keeping the listeners in order.
+        //
+        void compact()
+        {
+            assert(m_firing == 0);
+
+            size_t kept = 0;
+            for (size_t i = 0; i < m_entries.size(); ++i)
+            {
+                if (m_entries[i].valid)
+                {
+                    if (kept != i)
+                    {
+                        m_entries[kept] = std::move(m_entries[i]);
+                    }
+
+                    m_slots[m_entries[kept].slot].position = gsl::narrow_cast<uint32_t>(kept);
+                    ++kept;
+                }
+            }
+
+            m_entries.erase(m_entries.begin() + kept, m_entries.end());
+            m_visible = m_entries.size();
+            m_tombstones = 0;
+            m_released = false;
+        }
+
+        std::vector<entry> m_entries;
+        std::vector<entry> m_deferred;
+        std::vector<slot_location> m_slots;
+        uint32_t m_freeSlot = no_slot;
+        size_t m_visible = 0;
+        size_t m_tombstones = 0;
+        size_t m_firing = 0;
+        bool m_released = false;
+    };
+}}
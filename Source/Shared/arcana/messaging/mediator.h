@@ -6,10 +6,67 @@
 
 #include "router.h"
 
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 #include <gsl/gsl>
 
 namespace arcana
 {
+    namespace internal
+    {
+        //
+        // State that only gets allocated the first time it's used, which can happen on
+        // any thread. Moving it isn't thread safe, same as moving anything else.
+        //
+        template<typename T>
+        class lazy_state
+        {
+        public:
+            lazy_state() = default;
+
+            lazy_state(lazy_state&& other) noexcept
+                : m_state{ other.m_state.exchange(nullptr) }
+            {}
+
+            lazy_state& operator=(lazy_state&& other) noexcept
+            {
+                delete m_state.exchange(other.m_state.exchange(nullptr));
+                return *this;
+            }
+
+            ~lazy_state()
+            {
+                delete m_state.load();
+            }
+
+            T& get()
+            {
+                T* state = m_state.load(std::memory_order_acquire);
+                if (state == nullptr)
+                {
+                    // whoever loses the race throws away their state and uses the winner's
+                    auto created = std::make_unique<T>();
+                    if (m_state.compare_exchange_strong(state, created.get(), std::memory_order_acq_rel, std::memory_order_acquire))
+                    {
+                        state = created.release();
+                    }
+                }
+
+                return *state;
+            }
+
+        private:
+            std::atomic<T*> m_state{ nullptr };
+        };
+    }
+
     //
     // A mediator is an event pool that ensures all events are sent
     // through the right dispatcher (execution context).
@@ -34,6 +91,92 @@ namespace arcana
             m_dispatcher.queue([ this, evt = std::forward<T>(evt) ]() { m_router.fire(evt); });
         }
 
+        //
+        // Sends an event that supersedes the ones of the same type that haven't been delivered yet,
+        // for state like events where listeners only care about the latest value. Only the latest
+        // event gets delivered, once, by a single work item queued on the dispatcher when the first
+        // of them got sent. Events sent with send() in the meantime get delivered in between.
+        // The pending state of an event type is allocated the first time one gets sent.
+        //
+        template<typename T>
+        void send_latest(T&& evt)
+        {
+            using event = std::decay_t<T>;
+
+            auto& pending = std::get<internal::lazy_state<latest<event>>>(m_latest).get();
+
+            bool first;
+            {
+                std::lock_guard<std::mutex> guard{ pending.mutex };
+                pending.value = std::forward<T>(evt);
+                first = !std::exchange(pending.queued, true);
+            }
+
+            if (first)
+            {
+                queue_latest<event>();
+            }
+        }
+
+        //
+        // Same as send_latest(evt) but with one latest event per key, e.g. an entity id. The latest event
+        // of every key gets delivered, in the order the keys were first sent in since the last delivery.
+        //
+        template<typename T>
+        void send_latest(size_t key, T&& evt)
+        {
+            using event = std::decay_t<T>;
+
+            auto& pending = std::get<internal::lazy_state<latest<event>>>(m_latest).get();
+
+            bool first;
+            {
+                std::lock_guard<std::mutex> guard{ pending.mutex };
+                auto& position = pending.index[key];
+                if (position.delivery == pending.delivery)
+                {
+                    pending.keyed[position.index] = std::forward<T>(evt);
+                }
+                else
+                {
+                    position = { pending.keyed.size(), pending.delivery };
+                    pending.keyed.emplace_back(std::forward<T>(evt));
+                }
+                first = !std::exchange(pending.queued, true);
+            }
+
+            if (first)
+            {
+                queue_latest<event>();
+            }
+        }
+
+        //
+        // Sends an event that gets delivered along with the other events of its type sent in the meantime,
+        // as a single batch, by one work item queued on the dispatcher when the first of them got sent.
+        // Batch listeners get the whole batch at once, others get the events one at a time.
+        // The batch buffer of an event type is allocated the first time one gets sent.
+        //
+        template<typename T>
+        void send_batched(T&& evt)
+        {
+            using event = std::decay_t<T>;
+
+            auto& pending = std::get<internal::lazy_state<batched<event>>>(m_batched).get();
+
+            bool first;
+            {
+                std::lock_guard<std::mutex> guard{ pending.mutex };
+                pending.events.emplace_back(std::forward<T>(evt));
+                first = !std::exchange(pending.queued, true);
+            }
+
+            if (first)
+            {
+                m_dispatcher.queue([this] { deliver_batched<event>(); });
+            }
+        }
+
         template<typename EventT, typename T>
         ticket add_listener(T&& listener)
         {
@@ -41,13 +184,126 @@ namespace arcana
             return m_router.template add_listener<EventT>(std::forward<T>(listener));
         }
 
+        template<typename EventT, typename T>
+        ticket add_batch_listener(T&& listener)
+        {
+            GSL_CONTRACT_CHECK("thread affinity", m_dispatcher.get_affinity().check());
+            return m_router.template add_batch_listener<EventT>(std::forward<T>(listener));
+        }
+
         dispatcher_t& dispatcher()
         {
             return m_dispatcher;
         }
 
     private:
+        struct keyed_position
+        {
+            size_t index;
+
+            // the delivery the index is valid for, the index is stale for any other one
+            uint64_t delivery = std::numeric_limits<uint64_t>::max();
+        };
+
+        template<typename EventT>
+        struct latest
+        {
+            std::mutex mutex;
+            std::optional<EventT> value;
+            std::vector<EventT> keyed;
+
+            // kept across deliveries so that keys that keep getting sent don't allocate
+            std::unordered_map<size_t, keyed_position> index;
+            uint64_t delivery = 0;
+
+            bool queued = false;
+        };
+
+        // queued outside of the lock, dispatchers can run work inline
+        template<typename EventT>
+        void queue_latest()
+        {
+            m_dispatcher.queue([this] { deliver_latest<EventT>(); });
+        }
+
+        template<typename EventT>
+        void deliver_latest()
+        {
+            auto& pending = std::get<internal::lazy_state<latest<EventT>>>(m_latest).get();
+
+            std::optional<EventT> value;
+            std::vector<EventT> keyed;
+
+            {
+                std::lock_guard<std::mutex> guard{ pending.mutex };
+                pending.queued = false;
+                value.swap(pending.value);
+                keyed.swap(pending.keyed);
+                pending.delivery++;
+
+                // forget about the keys that stopped getting sent
+                if (pending.index.size() > 2 * keyed.size())
+                {
+                    pending.index.clear();
+                }
+            }
+
+            if (value)
+            {
+                m_router.fire(*value);
+            }
+
+            for (const EventT& evt : keyed)
+            {
+                m_router.fire(evt);
+            }
+
+            // hand the buffer back so that sending keyed events doesn't allocate once warm
+            keyed.clear();
+
+            std::lock_guard<std::mutex> guard{ pending.mutex };
+            if (pending.keyed.empty() && pending.keyed.capacity() < keyed.capacity())
+            {
+                pending.keyed.swap(keyed);
+            }
+        }
+
+        template<typename EventT>
+        struct batched
+        {
+            std::mutex mutex;
+            std::vector<EventT> events;
+            bool queued = false;
+        };
+
+        template<typename EventT>
+        void deliver_batched()
+        {
+            auto& pending = std::get<internal::lazy_state<batched<EventT>>>(m_batched).get();
+
+            std::vector<EventT> events;
+
+            {
+                std::lock_guard<std::mutex> guard{ pending.mutex };
+                pending.queued = false;
+                events.swap(pending.events);
+            }
+
+            m_router.template fire_batch<EventT>(events);
+
+            // hand the buffer back so that batching doesn't allocate once warm
+            events.clear();
+
+            std::lock_guard<std::mutex> guard{ pending.mutex };
+            if (pending.events.empty() && pending.events.capacity() < events.capacity())
+            {
+                pending.events.swap(events);
+            }
+        }
+
         dispatcher_t& m_dispatcher;
         router_t m_router;
+        std::tuple<internal::lazy_state<latest<EventTs>>...> m_latest;
+        std::tuple<internal::lazy_state<batched<EventTs>>...> m_batched;
     };
 }
@@ -2,12 +2,13 @@
 
 #include "arcana/finally_scope.h"
 #include "arcana/functional/inplace_function.h"
-#include "arcana/sentry.h"
 #include "arcana/threading/affinity.h"
 
-#include <algorithm>
+#include "internal/listener_list.h"
+
+#include <cassert>
 #include <tuple>
-#include <vector>
+#include <unordered_map>
 
 #include <gsl/gsl>
 
@@ -33,6 +34,8 @@ namespace arcana
         template<typename EventT>
         using listener_function = stdext::inplace_function<void(const EventT&), LISTENER_SIZE>;
 
+        template<typename EventT>
+        using batch_listener_function = stdext::inplace_function<void(gsl::span<const EventT>), LISTENER_SIZE>;
 
         /*
             Sends an event synchronously to all listeners.
@@ -44,35 +47,58 @@ namespace arcana
 
             using event = std::decay_t<EventT>;
 
-            auto& listeners = std::get<listener_group<event>>(m_listeners);
+            std::get<listener_group<event>>(m_listeners).fire(evt);
+            std::get<batch_listener_group<event>>(m_batchListeners).fire(gsl::span<const event>{ &evt, 1 });
+        }
+
+        /*
+            Sends an event synchronously to all listeners, followed by the listeners added for the given key.
+        */
+        template<typename EventT>
+        void fire(size_t key, const EventT& evt)
+        {
+            fire(evt);
+
+            using event = std::decay_t<EventT>;
 
+            auto& groups = std::get<keyed_listener_groups<event>>(m_keyedListeners);
+            auto found = groups.find(key);
+            if (found == groups.end())
             {
-                auto guard = std::get<sentry<event>>(m_sentries).take();
+                return;
+            }
 
-                for (listener<event>& listener : listeners)
-                {
-                    if (listener.valid)
-                    {
-                        listener.callback(evt);
-                    }
-                }
+            // references to the group stay valid if listeners add other keys, iterators don't
+            auto& listeners = found->second.listeners;
+            listeners.fire(evt);
+
+            if (listeners.size() == 0 && !listeners.firing())
+            {
+                groups.erase(key);
             }
+        }
+
+        /*
+            Sends a batch of events synchronously. Listeners get each event in turn,
+            as if they had been fired one by one, and batch listeners get them all at once.
+        */
+        template<typename EventT>
+        void fire_batch(gsl::span<const EventT> events)
+        {
+            GSL_CONTRACT_CHECK("thread affinity", m_affinity.check());
+
+            using event = std::decay_t<EventT>;
 
-            // if we're no longer iterating the listeners list in this stack
-            // remove all the unregistered listeners and add the pending ones
-            if (!std::get<sentry<event>>(m_sentries).is_active())
+            auto& listeners = std::get<listener_group<event>>(m_listeners);
+            if (listeners.size() != 0)
             {
-                listeners.erase(std::remove_if(listeners.begin(),
-                                               listeners.end(),
-                                               [](const listener<event>& l) { return !l.valid; }),
-                                listeners.end());
-
-                // move the pending listeners to the real list
-                // and clear the pending list
-                auto& pending = std::get<listener_group<event>>(m_pending);
-                std::move(pending.begin(), pending.end(), std::back_inserter(listeners));
-                pending.clear();
+                for (const event& evt : events)
+                {
+                    listeners.fire(evt);
+                }
             }
+
+            std::get<batch_listener_group<event>>(m_batchListeners).fire(events);
         }
 
         /*
@@ -86,6 +112,39 @@ namespace arcana
             return ticket{ [id, this] { internal_remove_listener<EventT>(id); } };
         }
 
+        /*
+            Adds an event listener that only gets the events fired for the given key, e.g. an entity id.
+            Firing an event for a key only costs as much as the number of listeners for that key.
+        */
+        template<typename EventT, typename T>
+        ticket add_listener(size_t key, T&& listener)
+        {
+            GSL_CONTRACT_CHECK("thread affinity", m_affinity.check());
+
+            using event = std::decay_t<EventT>;
+
+            auto& group = std::get<keyed_listener_groups<event>>(m_keyedListeners).try_emplace(key, *this, key).first->second;
+            auto id = group.listeners.add(std::forward<T>(listener));
+
+            return ticket{ [&group, id] { group.owner.internal_remove_keyed_listener(group, id); } };
+        }
+
+        /*
+            Adds a listener that gets events in batches, as a contiguous span, instead of one call per event.
+            Events sent through fire() come as batches of one.
+        */
+        template<typename EventT, typename T>
+        ticket add_batch_listener(T&& listener)
+        {
+            GSL_CONTRACT_CHECK("thread affinity", m_affinity.check());
+
+            using event = std::decay_t<EventT>;
+
+            auto id = static_cast<ticket_seed>(std::get<batch_listener_group<event>>(m_batchListeners).add(std::forward<T>(listener)));
+
+            return ticket{ [id, this] { internal_remove_batch_listener<event>(id); } };
+        }
+
         /*
             Sets the routers thread affinity. Once this is set the methods
             on this instance will need to be called by that thread.
@@ -106,15 +165,7 @@ namespace arcana
 
             using event = std::decay_t<EventT>;
 
-            // if we're currently firing an event in that group we need to wait until we're done before
-            // adding the listener to the list
-            auto& listeners = std::get<sentry<event>>(m_sentries).is_active()
-                                  ? std::get<listener_group<event>>(m_pending)
-                                  : std::get<listener_group<event>>(m_listeners);
-
-            auto id = m_nextId++;
-            listeners.emplace_back(std::forward<T>(listener), id);
-            return id;
+            return static_cast<ticket_seed>(std::get<listener_group<event>>(m_listeners).add(std::forward<T>(listener)));
         }
 
         /*
@@ -127,58 +178,71 @@ namespace arcana
 
             using event = std::decay_t<EventT>;
 
-            auto& listeners = std::get<listener_group<event>>(m_listeners);
-            auto found = std::find_if(listeners.begin(), listeners.end(), [id](const listener<event>& listener) {
-                return listener.id == id;
-            });
+            if (!std::get<listener_group<event>>(m_listeners).remove(static_cast<uint64_t>(id)))
+            {
+                assert(false && "removing item that isn't there");
+            }
+        }
+
+        template<typename EventT>
+        void internal_remove_batch_listener(const ticket_seed& id)
+        {
+            GSL_CONTRACT_CHECK("thread affinity", m_affinity.check());
 
-            if (found == listeners.end())
+            if (!std::get<batch_listener_group<EventT>>(m_batchListeners).remove(static_cast<uint64_t>(id)))
             {
                 assert(false && "removing item that isn't there");
-                return;
             }
+        }
+
+        template<typename EventT>
+        struct keyed_listener_group;
+
+        template<typename EventT>
+        void internal_remove_keyed_listener(keyed_listener_group<EventT>& group, uint64_t id)
+        {
+            GSL_CONTRACT_CHECK("thread affinity", m_affinity.check());
 
-            // don't modify the collection while iterating, just disable the listener
-            if (std::get<sentry<event>>(m_sentries).is_active())
+            if (!group.listeners.remove(id))
             {
-                found->valid = false;
+                assert(false && "removing item that isn't there");
+                return;
             }
-            else
+
+            // a group that's firing gets dropped by the fire once it's done
+            if (group.listeners.size() == 0 && !group.listeners.firing())
             {
-                listeners.erase(found);
+                std::get<keyed_listener_groups<EventT>>(m_keyedListeners).erase(group.key);
             }
         }
 
         template<typename EventT>
-        struct listener
-        {
-            using callback_t = listener_function<EventT>;
-
-            callback_t callback;
-            ticket_seed id;
-            bool valid;
+        using listener_group = internal::listener_list<listener_function<EventT>>;
 
-            listener(callback_t&& callback, const ticket_seed& id)
-                : callback{ std::move(callback) }
-                , id{ id }
-                , valid{ true }
+        template<typename EventT>
+        struct keyed_listener_group
+        {
+            keyed_listener_group(router& owner, size_t key)
+                : owner{ owner }
+                , key{ key }
             {}
 
-            listener(const callback_t& callback, const ticket_seed& id)
-                : callback{ callback }
-                , id{ id }
-                , valid{ true }
-            {}
+            router& owner;
+            size_t key;
+            listener_group<EventT> listeners;
         };
 
+        // groups are never moved once added, their tickets point straight at them
+        template<typename EventT>
+        using keyed_listener_groups = std::unordered_map<size_t, keyed_listener_group<EventT>>;
+
         template<typename EventT>
-        using listener_group = std::vector<listener<EventT>>;
+        using batch_listener_group = internal::listener_list<batch_listener_function<EventT>>;
 
         std::tuple<listener_group<EventTs>...> m_listeners;
-        std::tuple<sentry<EventTs>...> m_sentries;
-        std::tuple<listener_group<EventTs>...> m_pending;
+        std::tuple<batch_listener_group<EventTs>...> m_batchListeners;
+        std::tuple<keyed_listener_groups<EventTs>...> m_keyedListeners;
 
         affinity m_affinity;
-        ticket_seed m_nextId;
     };
 }
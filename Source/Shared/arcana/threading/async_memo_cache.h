@@ -0,0 +1,258 @@
+#pragma once
+
+#include "task.h"
+
+#include <algorithm>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace arcana
+{
+    //
+    // Deduplicates and memoizes asynchronous work by key.
+    //
+    // Concurrent requests for the same key share a single in-flight task, so the work only
+    // gets started once and every requester gets notified through a continuation on that task.
+    // Successful results are then kept for later requests, up to a capacity past which the least
+    // recently used ones get evicted. Failed results are dropped as soon as they complete so that
+    // the next request for that key starts the work again.
+    //
+    // Keys are spread over shards that each have their own lock, and the capacity is split evenly
+    // between the shards, which makes the eviction order only approximately least recently used.
+    // There are never more shards than the capacity, so the cache never holds more than that.
+    //
+    // The cache can be destroyed while requests are still in flight, their tasks still complete.
+    //
+    template<typename KeyT, typename ResultT, typename ErrorT, typename HashT = std::hash<KeyT>, typename KeyEqualT = std::equal_to<KeyT>>
+    class async_memo_cache
+    {
+    public:
+        using key_type = KeyT;
+        using task_t = task<ResultT, ErrorT>;
+
+        explicit async_memo_cache(size_t capacity, size_t shardCount = 16)
+            : m_state{ std::make_shared<state>(capacity, shardCount) }
+        {}
+
+        async_memo_cache(const async_memo_cache&) = delete;
+        async_memo_cache& operator=(const async_memo_cache&) = delete;
+
+        //
+        // Returns the task for the given key, invoking the factory to start the work
+        // if there is neither a completed nor an in-flight task for it. The factory
+        // must return a task_t and is invoked outside of the cache's locks.
+        //
+        // If the factory throws, the exception is forwarded to every requester of the key
+        // when ErrorT is std::exception_ptr. Factories of std::error_code caches must not throw.
+        //
+        template<typename FactoryT>
+        task_t get_or_add(const KeyT& key, FactoryT&& factory)
+        {
+            shard& shard = m_state->shard_for(key);
+
+            std::optional<task_completion_source<ResultT, ErrorT>> source;
+            uint64_t generation;
+
+            {
+                std::lock_guard<std::mutex> guard{ shard.mutex };
+
+                auto found = shard.entries.find(key);
+                if (found != shard.entries.end())
+                {
+                    if (found->second.completed)
+                    {
+                        shard.touch(found->second);
+                    }
+
+                    return found->second.result;
+                }
+
+                source.emplace();
+                generation = shard.nextGeneration++;
+
+                shard.entries.emplace(key, entry{ source->as_task(), generation });
+            }
+
+            // the work might complete, and the entry be evicted, before
+            // start returns so hold on to the task handed to the caller
+            task_t result = source->as_task();
+            start(key, generation, std::move(*source), std::forward<FactoryT>(factory));
+            return result;
+        }
+
+        //
+        // Removes the entry for the given key. An in-flight task still completes
+        // for whoever is waiting on it, but its result won't be kept.
+        //
+        void erase(const KeyT& key)
+        {
+            shard& shard = m_state->shard_for(key);
+
+            std::lock_guard<std::mutex> guard{ shard.mutex };
+
+            auto found = shard.entries.find(key);
+            if (found != shard.entries.end())
+            {
+                shard.erase(found);
+            }
+        }
+
+        //
+        // Removes every entry, see erase.
+        //
+        void clear()
+        {
+            for (auto& shard : m_state->shards)
+            {
+                std::lock_guard<std::mutex> guard{ shard.mutex };
+
+                shard.entries.clear();
+                shard.lru.clear();
+            }
+        }
+
+        //
+        // Returns the number of completed and in-flight entries.
+        //
+        size_t size() const
+        {
+            size_t count = 0;
+
+            for (auto& shard : m_state->shards)
+            {
+                std::lock_guard<std::mutex> guard{ shard.mutex };
+                count += shard.entries.size();
+            }
+
+            return count;
+        }
+
+    private:
+        struct entry
+        {
+            entry(task_t result, uint64_t generation)
+                : result{ std::move(result) }
+                , generation{ generation }
+            {}
+
+            task_t result;
+            uint64_t generation;
+            bool completed = false;
+            typename std::list<KeyT>::iterator lru{};
+        };
+
+        struct shard
+        {
+            using map_t = std::unordered_map<KeyT, entry, HashT, KeyEqualT>;
+
+            mutable std::mutex mutex;
+            map_t entries;
+            std::list<KeyT> lru; // completed entries only, most recently used first
+            size_t capacity = 0;
+            uint64_t nextGeneration = 0;
+
+            void touch(entry& found)
+            {
+                lru.splice(lru.begin(), lru, found.lru);
+            }
+
+            void erase(typename map_t::iterator found)
+            {
+                if (found->second.completed)
+                {
+                    lru.erase(found->second.lru);
+                }
+
+                entries.erase(found);
+            }
+
+            void completed(const KeyT& key, uint64_t generation, bool failed)
+            {
+                std::lock_guard<std::mutex> guard{ mutex };
+
+                // the entry might have been erased, or replaced by a newer request, in the meantime
+                auto found = entries.find(key);
+                if (found == entries.end() || found->second.generation != generation)
+                    return;
+
+                if (failed)
+                {
+                    entries.erase(found);
+                    return;
+                }
+
+                found->second.completed = true;
+                lru.push_front(key);
+                found->second.lru = lru.begin();
+
+                while (lru.size() > capacity)
+                {
+                    entries.erase(lru.back());
+                    lru.pop_back();
+                }
+            }
+        };
+
+        struct state
+        {
+            state(size_t capacity, size_t shardCount)
+                : shards(std::clamp<size_t>(shardCount, 1, std::max<size_t>(capacity, 1)))
+            {
+                // the first shards get the remainder so that the capacities add up to the requested one
+                const size_t perShard = capacity / shards.size();
+                const size_t remainder = capacity % shards.size();
+                for (size_t index = 0; index < shards.size(); ++index)
+                {
+                    shards[index].capacity = perShard + (index < remainder ? 1 : 0);
+                }
+            }
+
+            shard& shard_for(const KeyT& key)
+            {
+                return shards[hash(key) % shards.size()];
+            }
+
+            std::vector<shard> shards;
+            HashT hash;
+        };
+
+        template<typename FactoryT>
+        void start(const KeyT& key, uint64_t generation, task_completion_source<ResultT, ErrorT> source, FactoryT&& factory)
+        {
+            // continuations of std::exception_ptr tasks can't be noexcept
+            constexpr bool nothrow = !std::is_same<ErrorT, std::exception_ptr>::value;
+            auto complete = [weak = std::weak_ptr<state>{ m_state }, key, generation, source](const basic_expected<ResultT, ErrorT>& result) mutable noexcept(nothrow)
+            {
+                if (auto state = weak.lock())
+                {
+                    state->shard_for(key).completed(key, generation, result.has_error());
+                }
+
+                source.complete(result);
+            };
+
+            if constexpr (!nothrow)
+            {
+                try
+                {
+                    factory().then(inline_scheduler, cancellation::none(), std::move(complete));
+                }
+                catch (...)
+                {
+                    complete(basic_expected<ResultT, ErrorT>{ make_unexpected(std::current_exception()) });
+                }
+            }
+            else
+            {
+                factory().then(inline_scheduler, cancellation::none(), std::move(complete));
+            }
+        }
+
+        std::shared_ptr<state> m_state;
+    };
+}
@@ -5,11 +5,17 @@
 #include <atomic>
 #include <condition_variable>
 #include <limits>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
+#include <thread>
 #include <utility>
 #include <vector>
 
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#endif
+
 #ifdef ARCANA_TEST_HOOKS
 #include <functional>
 #endif
@@ -48,13 +54,163 @@ namespace arcana
     }
 #endif
 
-    template<typename T, size_t max_size = std::numeric_limits<size_t>::max()>
+    namespace internal
+    {
+        // Hints the processor that we're in a spin loop.
+        inline void cpu_relax() noexcept
+        {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+            _mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+            __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+            asm volatile("yield");
+#else
+            std::this_thread::yield();
+#endif
+        }
+
+        //
+        // FIFO queue stored in a ring buffer that only grows. Unlike std::queue, which
+        // allocates and frees blocks as items go through it, pushing into a ring_queue
+        // doesn't allocate once it has grown to the largest size it has to hold.
+        //
+        template<typename T>
+        class ring_queue
+        {
+        public:
+            ring_queue() = default;
+
+            ring_queue(ring_queue&& other) noexcept
+                : m_data{ std::exchange(other.m_data, nullptr) }
+                , m_capacity{ std::exchange(other.m_capacity, 0) }
+                , m_head{ std::exchange(other.m_head, 0) }
+                , m_size{ std::exchange(other.m_size, 0) }
+            {}
+
+            ring_queue& operator=(ring_queue&& other) noexcept
+            {
+                ring_queue moved{ std::move(other) };
+                std::swap(m_data, moved.m_data);
+                std::swap(m_capacity, moved.m_capacity);
+                std::swap(m_head, moved.m_head);
+                std::swap(m_size, moved.m_size);
+                return *this;
+            }
+
+            ring_queue(const ring_queue&) = delete;
+            ring_queue& operator=(const ring_queue&) = delete;
+
+            ~ring_queue()
+            {
+                while (!empty())
+                {
+                    pop();
+                }
+
+                if (m_data != nullptr)
+                {
+                    std::allocator<T>{}.deallocate(m_data, m_capacity);
+                }
+            }
+
+            bool empty() const
+            {
+                return m_size == 0;
+            }
+
+            size_t size() const
+            {
+                return m_size;
+            }
+
+            T& front()
+            {
+                return m_data[m_head];
+            }
+
+            template<typename G>
+            void push(G&& value)
+            {
+                if (m_size == m_capacity)
+                {
+                    grow();
+                }
+
+                new (&m_data[(m_head + m_size) & (m_capacity - 1)]) T(std::forward<G>(value));
+                ++m_size;
+            }
+
+            void pop()
+            {
+                m_data[m_head].~T();
+                m_head = (m_head + 1) & (m_capacity - 1);
+                --m_size;
+            }
+
+        private:
+            void grow()
+            {
+                // the capacity stays a power of two so that indices wrap around with a mask
+                const size_t capacity = m_capacity == 0 ? 16 : m_capacity * 2;
+                T* data = std::allocator<T>{}.allocate(capacity);
+
+                for (size_t index = 0; index < m_size; ++index)
+                {
+                    T& item = m_data[(m_head + index) & (m_capacity - 1)];
+                    new (&data[index]) T(std::move(item));
+                    item.~T();
+                }
+
+                if (m_data != nullptr)
+                {
+                    std::allocator<T>{}.deallocate(m_data, m_capacity);
+                }
+
+                m_data = data;
+                m_capacity = capacity;
+                m_head = 0;
+            }
+
+            T* m_data = nullptr;
+            size_t m_capacity = 0;
+            size_t m_head = 0;
+            size_t m_size = 0;
+        };
+    }
+
+    //
+    // Wait policy for blocking_concurrent_queue that parks consumers on a
+    // condition variable as soon as the queue is empty.
+    //
+    struct park_wait_policy
+    {
+        static constexpr size_t spin_count = 0;
+    };
+
+    //
+    // Wait policy for blocking_concurrent_queue that polls an empty queue SpinCount
+    // times before parking the consumer. This trades some CPU for not paying for a
+    // futex wait and wake up when producers and the consumer ping-pong work quickly.
+    //
+    template<size_t SpinCount = 2000>
+    struct spin_then_park_wait_policy
+    {
+        static constexpr size_t spin_count = SpinCount;
+    };
+
+    template<typename T, size_t max_size = std::numeric_limits<size_t>::max(), typename WaitPolicy = park_wait_policy>
     class blocking_concurrent_queue
     {
         // Reasoning 1:  notify should be called outside the lock to avoid "hurry up and wait"
         // http://en.cppreference.com/w/cpp/thread/condition_variable/notify_one
 
+        // Reasoning 2:  consumers register themselves in m_parked under the lock before waiting,
+        // so producers only need to notify when they see a parked consumer while holding the lock.
+
     public:
+        using wait_policy = WaitPolicy;
+
         template<typename G>
         void push(G&& data)
         {
@@ -62,13 +218,17 @@ namespace arcana
             {
                 std::unique_lock<std::mutex> lock{ m_mutex };
 
-                notify = m_data.empty();
                 m_data.push(std::forward<G>(data));
 
                 while (m_data.size() > max_size)
                 {
                     m_data.pop();
                 }
+
+                m_size.store(m_data.size(), std::memory_order_relaxed);
+
+                // See Reasoning 2
+                notify = m_parked > 0;
             }
             if (notify)
             {
@@ -84,6 +244,15 @@ namespace arcana
             return m_data.empty();
         }
 
+        //
+        // Number of queued items, read without taking the lock
+        // so it can be stale by the time the caller looks at it.
+        //
+        size_t size() const
+        {
+            return m_size.load(std::memory_order_relaxed);
+        }
+
         bool blocking_pop(T& dest, const cancellation& cancel)
         {
             return internal_pop(dest, cancel, true);
@@ -106,13 +275,14 @@ namespace arcana
 
         void clear()
         {
-            std::queue<T> empty;
+            internal::ring_queue<T> empty;
             {
                 std::unique_lock<std::mutex> lock{ m_mutex };
 
                 // swap with empty so that destruction of the queue items
                 // don't occure in the lock
                 std::swap(m_data, empty);
+                m_size.store(0, std::memory_order_relaxed);
             }
 
             // See Reasoning 1
@@ -126,19 +296,48 @@ namespace arcana
         }
 
     private:
+        void wait_for_data(std::unique_lock<std::mutex>& lock, const cancellation& cancel)
+        {
+            if constexpr (WaitPolicy::spin_count > 0)
+            {
+                // spinning on a single core only delays the producer we're waiting for
+                static const bool multicore = std::thread::hardware_concurrency() > 1;
+
+                if (multicore && m_data.empty())
+                {
+                    lock.unlock();
+
+                    for (size_t spin = 0; spin < WaitPolicy::spin_count; ++spin)
+                    {
+                        if (m_size.load(std::memory_order_relaxed) != 0 || cancel.cancelled())
+                            break;
+
+                        internal::cpu_relax();
+                    }
+
+                    lock.lock();
+                }
+            }
+
+            while (!cancel.cancelled() && m_data.empty())
+            {
+#ifdef ARCANA_TEST_HOOKS
+                test_hooks::blocking_concurrent_queue::detail::invoke_before_wait_callback();
+#endif
+                // See Reasoning 2
+                m_parked++;
+                m_dataReady.wait(lock);
+                m_parked--;
+            }
+        }
+
         bool internal_pop(T& dest, const cancellation& cancel, bool block)
         {
             std::unique_lock<std::mutex> lock{ m_mutex };
 
             if (block)
             {
-                while (!cancel.cancelled() && m_data.empty())
-                {
-#ifdef ARCANA_TEST_HOOKS
-                    test_hooks::blocking_concurrent_queue::detail::invoke_before_wait_callback();
-#endif
-                    m_dataReady.wait(lock);
-                }
+                wait_for_data(lock, cancel);
             }
 
             if (m_data.empty() || cancel.cancelled())
@@ -146,6 +345,7 @@ namespace arcana
 
             dest = std::move(m_data.front());
             m_data.pop();
+            m_size.store(m_data.size(), std::memory_order_relaxed);
 
             return true;
         }
@@ -156,13 +356,7 @@ namespace arcana
 
             if (block)
             {
-                while (!cancel.cancelled() && m_data.empty())
-                {
-#ifdef ARCANA_TEST_HOOKS
-                    test_hooks::blocking_concurrent_queue::detail::invoke_before_wait_callback();
-#endif
-                    m_dataReady.wait(lock);
-                }
+                wait_for_data(lock, cancel);
             }
 
             if (m_data.empty() || cancel.cancelled())
@@ -174,11 +368,19 @@ namespace arcana
                 m_data.pop();
             }
 
+            m_size.store(0, std::memory_order_relaxed);
+
             return true;
         }
 
-        std::queue<T> m_data;
+        internal::ring_queue<T> m_data;
         mutable std::mutex m_mutex;
         std::condition_variable m_dataReady;
+
+        // m_data.size() mirrored for spinning consumers that don't hold the lock
+        std::atomic<size_t> m_size{ 0 };
+
+        // number of consumers waiting on m_dataReady, only accessed under the lock
+        size_t m_parked = 0;
     };
 }
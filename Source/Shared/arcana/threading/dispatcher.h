@@ -5,23 +5,105 @@
 
 #include "affinity.h"
 #include "blocking_concurrent_queue.h"
+#include "dispatcher_metrics.h"
+#include "dispatcher_tracking.h"
 
 #include <gsl/gsl>
+#include <limits>
+#include <type_traits>
 #include <vector>
 
 namespace arcana
 {
-    template<size_t WorkSize>
+    namespace internal
+    {
+        //
+        // A queued work item, which only carries the name and the timestamp
+        // when the dispatcher's tracking and metrics policies need them.
+        //
+        template<typename CallbackT, bool Named, bool Timestamped>
+        struct queued_work;
+
+        template<typename CallbackT>
+        struct queued_work<CallbackT, false, false>
+        {
+            CallbackT work;
+        };
+
+        template<typename CallbackT>
+        struct queued_work<CallbackT, true, false>
+        {
+            CallbackT work;
+            const char* name = nullptr;
+        };
+
+        template<typename CallbackT>
+        struct queued_work<CallbackT, false, true>
+        {
+            CallbackT work;
+            dispatcher_metrics::clock::time_point queued{};
+        };
+
+        template<typename CallbackT>
+        struct queued_work<CallbackT, true, true>
+        {
+            CallbackT work;
+            const char* name = nullptr;
+            dispatcher_metrics::clock::time_point queued{};
+        };
+    }
+
+    //
+    // WaitPolicy controls how a blocking tick waits for work, see
+    // park_wait_policy and spin_then_park_wait_policy.
+    //
+    // MetricsT is no_dispatcher_metrics by default, dispatcher_metrics
+    // makes the dispatcher keep track of its queue depth, wait times and tick durations.
+    //
+    // TrackingT is no_dispatcher_tracking by default, dispatcher_tracking
+    // makes the dispatcher publish which work item it's running for a dispatcher_watchdog.
+    //
+    template<size_t WorkSize, typename WaitPolicy = park_wait_policy, typename MetricsT = no_dispatcher_metrics, typename TrackingT = no_dispatcher_tracking>
     class dispatcher
     {
     public:
         using callback_t = stdext::inplace_function<void(), WorkSize>;
+        using wait_policy = WaitPolicy;
         static constexpr size_t work_size = WorkSize;
+        static constexpr bool collects_metrics = !std::is_same<MetricsT, no_dispatcher_metrics>::value;
+        static constexpr bool tracks_work = !std::is_same<TrackingT, no_dispatcher_tracking>::value;
 
         template<typename T>
         void queue(T&& work)
         {
-            m_work.push(std::forward<T>(work));
+            queue(nullptr, std::forward<T>(work));
+        }
+
+        //
+        // Queues work with a name that identifies it while it runs, e.g. when
+        // a dispatcher_watchdog reports it. The name has to outlive the work,
+        // and is ignored unless the dispatcher uses dispatcher_tracking.
+        //
+        template<typename T>
+        void queue([[maybe_unused]] const char* name, T&& work)
+        {
+            work_t item{ callback_t{ std::forward<T>(work) } };
+
+            if constexpr (tracks_work)
+            {
+                item.name = name;
+            }
+
+            if constexpr (collects_metrics)
+            {
+                item.queued = dispatcher_metrics::clock::now();
+                m_work.push(std::move(item));
+                m_metrics.queued(m_work.size());
+            }
+            else
+            {
+                m_work.push(std::move(item));
+            }
         }
 
         template<typename T>
@@ -35,6 +117,30 @@ namespace arcana
             return m_affinity;
         }
 
+        //
+        // Can be called from any thread, including while the dispatcher is ticking.
+        //
+        dispatcher_metrics_snapshot metrics() const
+        {
+            static_assert(collects_metrics, "metrics are only available with the dispatcher_metrics policy");
+            return m_metrics.snapshot(m_work.size());
+        }
+
+        void reset_metrics()
+        {
+            static_assert(collects_metrics, "metrics are only available with the dispatcher_metrics policy");
+            m_metrics.reset();
+        }
+
+        //
+        // Can be called from any thread, including while the dispatcher is ticking.
+        //
+        const TrackingT& running() const
+        {
+            static_assert(tracks_work, "running work is only available with the dispatcher_tracking policy");
+            return m_tracking;
+        }
+
         dispatcher(const dispatcher&) = delete;
         dispatcher& operator=(const dispatcher&) = delete;
 
@@ -90,9 +196,29 @@ namespace arcana
                     return false;
             }
 
-            for (auto& work : m_workload)
+            if constexpr (collects_metrics)
             {
-                work();
+                const auto tickStart = dispatcher_metrics::clock::now();
+
+                for (auto& item : m_workload)
+                {
+                    m_metrics.started(dispatcher_metrics::clock::now() - item.queued);
+                    run(item);
+                }
+
+                m_metrics.ticked(dispatcher_metrics::clock::now() - tickStart);
+            }
+            else
+            {
+                for (auto& item : m_workload)
+                {
+                    run(item);
+                }
+            }
+
+            if constexpr (tracks_work)
+            {
+                m_tracking.idle();
             }
 
             m_workload.clear();
@@ -100,60 +226,169 @@ namespace arcana
             return true;
         }
 
-        blocking_concurrent_queue<callback_t> m_work;
+        using work_t = internal::queued_work<callback_t, tracks_work, collects_metrics>;
+
+        void run(work_t& item)
+        {
+            if constexpr (tracks_work)
+            {
+                m_tracking.start(item.name);
+            }
+
+            item.work();
+        }
+
+        blocking_concurrent_queue<work_t, std::numeric_limits<size_t>::max(), WaitPolicy> m_work;
         affinity m_affinity;
-        std::vector<callback_t> m_workload;
+        std::vector<work_t> m_workload;
+        [[no_unique_address]] MetricsT m_metrics;
+        [[no_unique_address]] TrackingT m_tracking;
     };
 
-    template<size_t WorkSize>
-    class manual_dispatcher : public dispatcher<WorkSize>
+    namespace internal
     {
-    public:
-        using dispatcher<WorkSize>::blocking_tick;
-        using dispatcher<WorkSize>::cancelled;
-        using dispatcher<WorkSize>::clear;
-        using dispatcher<WorkSize>::set_affinity;
-        using dispatcher<WorkSize>::tick;
-    };
+        // Number of inline_if_affine_scheduler calls currently nested on this thread.
+        inline thread_local size_t inline_dispatch_depth = 0;
+    }
 
-    template<size_t WorkSize>
-    class background_dispatcher : public dispatcher<WorkSize>
+    //
+    // Scheduler wrapper that runs work immediately when it is scheduled from the
+    // thread the dispatcher is affine to, and queues it on the dispatcher otherwise.
+    // This removes a full tick of latency per hop for continuation chains that stay
+    // on the dispatcher's thread, at the cost of running that work ahead of whatever
+    // is already sitting in the queue.
+    //
+    // Work only runs inline once the dispatcher's affinity has been set. Nesting is
+    // bounded by MaxDepth per thread, past which work gets queued like usual so that
+    // long inline chains can't blow up the stack.
+    //
+    template<typename DispatcherT, size_t MaxDepth = 16>
+    class inline_if_affine_scheduler
     {
     public:
-        background_dispatcher()
-            : m_registration{ m_cancellation.add_listener([this] { this->cancelled(); }) }
-        {
-            m_thread = std::thread{ [&]() {
+        static constexpr size_t max_depth = MaxDepth;
 
-                this->set_affinity(std::this_thread::get_id());
+        explicit inline_if_affine_scheduler(DispatcherT& dispatcher)
+            : m_dispatcher{ dispatcher }
+        {}
 
-                while (!m_cancellation.cancelled())
+        template<typename T>
+        void queue(T&& work)
+        {
+            size_t& depth = internal::inline_dispatch_depth;
+            if (depth < MaxDepth)
+            {
+                const affinity aff = m_dispatcher.get_affinity();
+                if (aff.is_set() && aff.check())
                 {
-                    this->blocking_tick(m_cancellation);
+                    ++depth;
+                    auto restore = gsl::finally([&depth] { --depth; });
+
+                    work();
+                    return;
                 }
-            } };
+            }
+
+            m_dispatcher.queue(std::forward<T>(work));
         }
 
-        void cancel()
+        template<typename T>
+        void operator()(T&& work)
         {
-            m_cancellation.cancel();
-
-            if (m_thread.joinable())
-            {
-                m_thread.join();
-            }
+            queue(std::forward<T>(work));
+        }
 
-            this->clear();
+        affinity get_affinity() const
+        {
+            return m_dispatcher.get_affinity();
         }
 
-        ~background_dispatcher()
+        DispatcherT& dispatcher() const
         {
-            cancel();
+            return m_dispatcher;
         }
 
     private:
-        std::thread m_thread;
-        cancellation_source m_cancellation;
-        cancellation_source::ticket m_registration;
+        DispatcherT& m_dispatcher;
+    };
+
+    template<size_t WorkSize, typename WaitPolicy = park_wait_policy, typename MetricsT = no_dispatcher_metrics, typename TrackingT = no_dispatcher_tracking>
+    class manual_dispatcher : public dispatcher<WorkSize, WaitPolicy, MetricsT, TrackingT>
+    {
+    public:
+        using dispatcher<WorkSize, WaitPolicy, MetricsT, TrackingT>::blocking_tick;
+        using dispatcher<WorkSize, WaitPolicy, MetricsT, TrackingT>::cancelled;
+        using dispatcher<WorkSize, WaitPolicy, MetricsT, TrackingT>::clear;
+        using dispatcher<WorkSize, WaitPolicy, MetricsT, TrackingT>::set_affinity;
+        using dispatcher<WorkSize, WaitPolicy, MetricsT, TrackingT>::tick;
+    };
+
+    namespace internal
+    {
+        //
+        // Ticks a dispatcher on a thread of its own until it gets cancelled.
+        // The init callable runs on that thread before it starts processing work.
+        //
+        template<typename DispatcherT>
+        class background_thread : public DispatcherT
+        {
+        public:
+            template<typename InitT>
+            explicit background_thread(InitT&& init)
+                : m_registration{ m_cancellation.add_listener([this] { this->cancelled(); }) }
+            {
+                m_thread = std::thread{ [this, init = std::forward<InitT>(init)]() mutable {
+
+                    init();
+
+                    this->set_affinity(std::this_thread::get_id());
+
+                    while (!m_cancellation.cancelled())
+                    {
+                        this->blocking_tick(m_cancellation);
+                    }
+                } };
+            }
+
+            void cancel()
+            {
+                m_cancellation.cancel();
+
+                if (m_thread.joinable())
+                {
+                    m_thread.join();
+                }
+
+                this->clear();
+            }
+
+            ~background_thread()
+            {
+                cancel();
+            }
+
+        private:
+            std::thread m_thread;
+            cancellation_source m_cancellation;
+            cancellation_source::ticket m_registration;
+        };
+    }
+
+    template<size_t WorkSize, typename WaitPolicy = park_wait_policy, typename MetricsT = no_dispatcher_metrics, typename TrackingT = no_dispatcher_tracking>
+    class background_dispatcher : public internal::background_thread<dispatcher<WorkSize, WaitPolicy, MetricsT, TrackingT>>
+    {
+    public:
+        background_dispatcher()
+            : background_dispatcher([] {})
+        {}
+
+        //
+        // Creates a dispatcher whose thread invokes init before it starts processing work,
+        // which lets callers name the thread or restrict it to some processors.
+        //
+        template<typename InitT>
+        explicit background_dispatcher(InitT&& init)
+            : internal::background_thread<dispatcher<WorkSize, WaitPolicy, MetricsT, TrackingT>>{ std::forward<InitT>(init) }
+        {}
     };
 }
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace arcana
+{
+    //
+    // Point in time view of a dispatcher's metrics. Every field is read atomically but the
+    // snapshot as a whole isn't, so fields can be off by the work that ran while it was taken.
+    //
+    struct dispatcher_metrics_snapshot
+    {
+        // number of work items queued and not picked up by a tick yet
+        size_t depth;
+
+        // largest depth seen since the last reset
+        size_t high_water_depth;
+
+        // time work items spent in the queue before running
+        uint64_t items_run;
+        std::chrono::nanoseconds total_wait;
+        std::chrono::nanoseconds max_wait;
+
+        // time ticks spent running the work they picked up
+        uint64_t ticks;
+        std::chrono::nanoseconds total_tick;
+        std::chrono::nanoseconds max_tick;
+    };
+
+    //
+    // Metrics policy for dispatchers that don't collect metrics, which is the default.
+    //
+    struct no_dispatcher_metrics
+    {};
+
+    //
+    // Metrics policy for dispatchers that timestamps queued work and tracks the queue
+    // depth, wait time and tick duration in counters that can be read from any thread
+    // through the dispatcher's metrics() without blocking it.
+    //
+    class dispatcher_metrics
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        void queued(size_t depth)
+        {
+            size_t highWater = m_highWater.load(std::memory_order_relaxed);
+            while (depth > highWater && !m_highWater.compare_exchange_weak(highWater, depth, std::memory_order_relaxed))
+            {}
+        }
+
+        void started(clock::duration wait)
+        {
+            m_itemsRun.fetch_add(1, std::memory_order_relaxed);
+            add(m_totalWait, m_maxWait, wait);
+        }
+
+        void ticked(clock::duration duration)
+        {
+            m_ticks.fetch_add(1, std::memory_order_relaxed);
+            add(m_totalTick, m_maxTick, duration);
+        }
+
+        dispatcher_metrics_snapshot snapshot(size_t depth) const
+        {
+            return {
+                depth,
+                std::max(depth, m_highWater.load(std::memory_order_relaxed)),
+                m_itemsRun.load(std::memory_order_relaxed),
+                std::chrono::nanoseconds{ m_totalWait.load(std::memory_order_relaxed) },
+                std::chrono::nanoseconds{ m_maxWait.load(std::memory_order_relaxed) },
+                m_ticks.load(std::memory_order_relaxed),
+                std::chrono::nanoseconds{ m_totalTick.load(std::memory_order_relaxed) },
+                std::chrono::nanoseconds{ m_maxTick.load(std::memory_order_relaxed) },
+            };
+        }
+
+        void reset()
+        {
+            m_highWater = 0;
+            m_itemsRun = 0;
+            m_totalWait = 0;
+            m_maxWait = 0;
+            m_ticks = 0;
+            m_totalTick = 0;
+            m_maxTick = 0;
+        }
+
+    private:
+        static void add(std::atomic<int64_t>& total, std::atomic<int64_t>& max, clock::duration duration)
+        {
+            const int64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+
+            total.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+            // only the ticking thread updates the maximums, no need for a compare exchange loop
+            if (nanoseconds > max.load(std::memory_order_relaxed))
+            {
+                max.store(nanoseconds, std::memory_order_relaxed);
+            }
+        }
+
+        std::atomic<size_t> m_highWater{ 0 };
+        std::atomic<uint64_t> m_itemsRun{ 0 };
+        std::atomic<int64_t> m_totalWait{ 0 };
+        std::atomic<int64_t> m_maxWait{ 0 };
+        std::atomic<uint64_t> m_ticks{ 0 };
+        std::atomic<int64_t> m_totalTick{ 0 };
+        std::atomic<int64_t> m_maxTick{ 0 };
+    };
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "dispatcher.h"
+
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace arcana
+{
+    //
+    // A fixed set of background dispatchers. Work queued on the pool itself is spread
+    // round-robin over the dispatchers, and for_key routes all work for a key to the
+    // same dispatcher so that it runs in order on one thread.
+    //
+    // The init callable is invoked on each dispatcher's thread with the dispatcher's
+    // index before it processes any work, which is where platform specific setup like
+    // set_thread_name or pin_current_thread belongs.
+    //
+    template<size_t WorkSize, typename WaitPolicy = park_wait_policy, typename MetricsT = no_dispatcher_metrics, typename TrackingT = no_dispatcher_tracking>
+    class dispatcher_pool
+    {
+    public:
+        using dispatcher_t = background_dispatcher<WorkSize, WaitPolicy, MetricsT, TrackingT>;
+
+        explicit dispatcher_pool(size_t count)
+            : dispatcher_pool(count, [](size_t) {})
+        {}
+
+        template<typename InitT>
+        dispatcher_pool(size_t count, InitT&& init)
+        {
+            assert(count > 0 && "a dispatcher pool needs at least one dispatcher");
+
+            m_dispatchers.reserve(count);
+            for (size_t index = 0; index < count; ++index)
+            {
+                m_dispatchers.emplace_back(std::make_unique<dispatcher_t>([init, index]() mutable { init(index); }));
+            }
+        }
+
+        dispatcher_pool(const dispatcher_pool&) = delete;
+        dispatcher_pool& operator=(const dispatcher_pool&) = delete;
+
+        size_t size() const
+        {
+            return m_dispatchers.size();
+        }
+
+        dispatcher_t& at(size_t index)
+        {
+            return *m_dispatchers.at(index);
+        }
+
+        //
+        // Returns the dispatchers one after the other.
+        //
+        dispatcher_t& next()
+        {
+            return *m_dispatchers[m_next.fetch_add(1, std::memory_order_relaxed) % m_dispatchers.size()];
+        }
+
+        //
+        // Returns the dispatcher that owns the key.
+        //
+        template<typename KeyT, typename HashT = std::hash<KeyT>>
+        dispatcher_t& for_key(const KeyT& key, const HashT& hash = {})
+        {
+            return *m_dispatchers[hash(key) % m_dispatchers.size()];
+        }
+
+        template<typename T>
+        void queue(T&& work)
+        {
+            next().queue(std::forward<T>(work));
+        }
+
+        template<typename T>
+        void operator()(T&& work)
+        {
+            queue(std::forward<T>(work));
+        }
+
+        //
+        // Stops every dispatcher, dropping the work that hasn't run yet.
+        //
+        void cancel()
+        {
+            for (auto& dispatcher : m_dispatchers)
+            {
+                dispatcher->cancel();
+            }
+        }
+
+    private:
+        std::vector<std::unique_ptr<dispatcher_t>> m_dispatchers;
+        std::atomic<size_t> m_next{ 0 };
+    };
+}
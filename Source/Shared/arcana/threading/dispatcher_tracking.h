@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace arcana
+{
+    //
+    // Tracking policy for dispatchers that don't publish what they're running, which is the default.
+    // Names passed to queue are dropped.
+    //
+    struct no_dispatcher_tracking
+    {};
+
+    //
+    // Tracking policy for dispatchers that publish which work item they're running so that
+    // a dispatcher_watchdog can look at it from other threads. Queued work keeps its name, and
+    // the ticking thread bumps the sequence for every work item and resets it to 0 once it's
+    // done with a tick, which costs two relaxed stores per work item.
+    //
+    class dispatcher_tracking
+    {
+    public:
+        void start(const char* name)
+        {
+            m_sequence.store(++m_last, std::memory_order_relaxed);
+            m_name.store(name, std::memory_order_relaxed);
+        }
+
+        void idle()
+        {
+            m_sequence.store(0, std::memory_order_relaxed);
+        }
+
+        // sequence of the running work item, or 0 if none
+        uint64_t sequence() const
+        {
+            return m_sequence.load(std::memory_order_relaxed);
+        }
+
+        const char* name() const
+        {
+            return m_name.load(std::memory_order_relaxed);
+        }
+
+    private:
+        uint64_t m_last = 0;
+        std::atomic<uint64_t> m_sequence{ 0 };
+        std::atomic<const char*> m_name{ nullptr };
+    };
+}
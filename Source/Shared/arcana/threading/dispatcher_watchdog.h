@@ -0,0 +1,178 @@
+#pragma once
+
+#include "arcana/containers/ticketed_collection.h"
+
+#include "dispatcher.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace arcana
+{
+    struct dispatcher_stall
+    {
+        // name the dispatcher was watched with
+        const char* dispatcher;
+
+        // name the work item was queued with, or null
+        const char* work;
+
+        // how long the work item has been running for, at least
+        std::chrono::steady_clock::duration elapsed;
+    };
+
+    //
+    // Reports work items that block the dispatcher they run on for longer than a threshold,
+    // which would otherwise silently stall everything queued behind them.
+    //
+    // Only dispatchers with the dispatcher_tracking policy can be watched. They publish which
+    // work item they're running with two relaxed stores per item, and the watchdog's own thread
+    // samples that a few times per threshold. A work item is reported once, on the watchdog's
+    // thread, when it's seen running for longer than the threshold.
+    //
+    // The optional annotate callback is invoked for every stall as well, and whatever it returns
+    // is held until the stalled work item is done, e.g. a trace_region named after the work item.
+    // It runs while the watchdog holds its lock, so it has to be quick and can't call watch.
+    //
+    class dispatcher_watchdog
+    {
+        struct watched_dispatcher;
+
+    public:
+        using callback_t = std::function<void(const dispatcher_stall&)>;
+        using annotate_t = std::function<std::shared_ptr<void>(const dispatcher_stall&)>;
+        using ticket = ticketed_collection<std::shared_ptr<watched_dispatcher>>::ticket;
+
+        dispatcher_watchdog(std::chrono::milliseconds threshold, callback_t callback, annotate_t annotate = {})
+            : m_threshold{ threshold }
+            , m_callback{ std::move(callback) }
+            , m_annotate{ std::move(annotate) }
+            , m_thread{ [this] { run(); } }
+        {}
+
+        dispatcher_watchdog(const dispatcher_watchdog&) = delete;
+        dispatcher_watchdog& operator=(const dispatcher_watchdog&) = delete;
+
+        ~dispatcher_watchdog()
+        {
+            {
+                std::lock_guard<std::mutex> guard{ m_mutex };
+                m_stopped = true;
+            }
+
+            m_wakeup.notify_one();
+            m_thread.join();
+        }
+
+        //
+        // Watches the dispatcher until the returned ticket is destroyed, which
+        // has to happen before the dispatcher or the watchdog are destroyed.
+        //
+        template<typename DispatcherT>
+        ticket watch(const DispatcherT& dispatcher, const char* name)
+        {
+            static_assert(DispatcherT::tracks_work, "only dispatchers with the dispatcher_tracking policy can be watched");
+
+            std::lock_guard<std::mutex> guard{ m_mutex };
+            return m_watched.insert(std::make_shared<watched_dispatcher>(dispatcher.running(), name), m_mutex);
+        }
+
+    private:
+        struct watched_dispatcher
+        {
+            watched_dispatcher(const dispatcher_tracking& running, const char* name)
+                : running{ running }
+                , name{ name }
+            {}
+
+            const dispatcher_tracking& running;
+            const char* name;
+
+            uint64_t sequence = 0;
+            std::chrono::steady_clock::time_point since{};
+            bool reported = false;
+            std::shared_ptr<void> annotation{};
+        };
+
+        void run()
+        {
+            // sampling a few times per threshold keeps stalls from being reported much later than they happen
+            const auto interval = std::max<std::chrono::steady_clock::duration>(m_threshold / 4, std::chrono::milliseconds{ 1 });
+
+            std::vector<dispatcher_stall> stalls;
+
+            std::unique_lock<std::mutex> lock{ m_mutex };
+            while (!m_wakeup.wait_for(lock, interval, [this] { return m_stopped; }))
+            {
+                const auto now = std::chrono::steady_clock::now();
+
+                for (const auto& watched : m_watched)
+                {
+                    check(*watched, now, stalls);
+                }
+
+                if (stalls.empty())
+                    continue;
+
+                // the callback can take its time or watch other dispatchers without holding up anyone
+                lock.unlock();
+
+                for (const auto& stall : stalls)
+                {
+                    m_callback(stall);
+                }
+                stalls.clear();
+
+                lock.lock();
+            }
+        }
+
+        void check(watched_dispatcher& watched, std::chrono::steady_clock::time_point now, std::vector<dispatcher_stall>& stalls)
+        {
+            const uint64_t sequence = watched.running.sequence();
+            const char* work = watched.running.name();
+
+            if (sequence == 0 || sequence != watched.sequence)
+            {
+                // a different work item, or none, is running since the last time we looked
+                watched.sequence = sequence;
+                watched.since = now;
+                watched.reported = false;
+                watched.annotation.reset();
+                return;
+            }
+
+            const auto elapsed = now - watched.since;
+            if (watched.reported || elapsed < m_threshold)
+                return;
+
+            // the name could belong to the next work item if it started while we were reading
+            if (watched.running.sequence() != sequence)
+                return;
+
+            watched.reported = true;
+            stalls.push_back({ watched.name, work, elapsed });
+
+            if (m_annotate)
+            {
+                watched.annotation = m_annotate(stalls.back());
+            }
+        }
+
+        const std::chrono::milliseconds m_threshold;
+        const callback_t m_callback;
+        const annotate_t m_annotate;
+
+        std::mutex m_mutex;
+        std::condition_variable m_wakeup;
+        bool m_stopped = false;
+        ticketed_collection<std::shared_ptr<watched_dispatcher>> m_watched;
+
+        std::thread m_thread;
+    };
+}
@@ -5,11 +5,19 @@
 #include "arcana/functional/inplace_function.h"
 #include "arcana/type_traits.h"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <mutex>
 #include <optional>
 #include <thread>
 #include <variant>
 
+#ifdef ARCANA_TASK_HOOKS
+#include "arcana/threading/task_hooks.h"
+#endif
+
 namespace arcana
 {
     template<typename ResultT, typename ErrorT>
@@ -17,6 +25,24 @@ namespace arcana
 
     namespace internal
     {
+        //
+        // Inline continuations on tasks that already completed normally run right away without
+        // getting a payload of their own, and successful ready void tasks all share one payload.
+        // Instrumented builds give them payloads anyway, so that they report every step of
+        // their lifecycle like any other task.
+        //
+#ifdef ARCANA_TASK_HOOKS
+        inline constexpr bool elides_ready_payloads = false;
+#else
+        inline constexpr bool elides_ready_payloads = true;
+#endif
+
+        template<typename SchedulerT>
+        using is_inline_scheduler = std::is_same<std::decay_t<SchedulerT>, std::decay_t<decltype(inline_scheduler)>>;
+
+        template<typename ResultT, typename ErrorT>
+        task<ResultT, ErrorT> make_ready_task(basic_expected<ResultT, ErrorT> result);
+
         struct base_task_payload
         {
         public:
@@ -66,10 +92,18 @@ namespace arcana
                     parent = newParent;
                 }
 
+                std::shared_ptr<base_task_payload> lock_parent() const
+                {
+                    return parent.lock();
+                }
+
                 void run()
                 {
                     assert(parent.lock() && "parent of a continuation can't be null");
 
+#ifdef ARCANA_TASK_HOOKS
+                    continuation->m_tracker.scheduled();
+#endif
                     schedulingFunction([shared = parent.lock(), continuation = std::move(continuation)]
                     {
                         assert(shared.get() && "parent of a continuation can't be null");
@@ -101,6 +135,9 @@ namespace arcana
 
             void run(base_task_payload* parent)
             {
+#ifdef ARCANA_TASK_HOOKS
+                m_tracker.started();
+#endif
                 if (m_work != nullptr)
                 {
                     m_work(*this, parent);
@@ -128,9 +165,102 @@ namespace arcana
                 do_completion();
             }
 
+            //
+            // Runs work that continues an already completed task on the calling thread, counting it
+            // against the thread's trampoline like any other inline continuation. Returns false without
+            // running the work when the stack is already as deep as the trampoline allows, in which case
+            // the work has to go through a regular continuation that gets parked.
+            //
+            template<typename WorkT>
+            static bool run_inline(WorkT&& work)
+            {
+                trampoline& tramp = current_trampoline();
+
+                if (tramp.depth >= trampoline::max_depth)
+                    return false;
+
+                {
+                    ++tramp.depth;
+                    auto restore = gsl::finally([&tramp] { --tramp.depth; });
+
+                    work();
+                }
+
+                if (tramp.depth == 0)
+                {
+                    run_parked(tramp);
+                }
+
+                return true;
+            }
+
+            //
+            // Blocks the calling thread until this task completes and returns the payload
+            // holding its result, which is another one if this task got redirected.
+            // The returned payload lives as long as this one does since the redirect
+            // chain keeps it alive, and a completed task never gets redirected again.
+            //
+            base_task_payload& wait()
+            {
+                std::shared_ptr<base_task_payload> hold;
+
+                base_task_payload* current = this;
+                while (true)
+                {
+                    current->m_completed.wait(false);
+
+                    auto redirect = current->redirect();
+                    if (!redirect)
+                        return *current;
+
+                    hold = std::move(redirect);
+                    current = hold.get();
+                }
+            }
+
+            //
+            // Same as wait() but gives up once the deadline is reached, in which case it returns null.
+            //
+            template<typename ClockT, typename DurationT>
+            base_task_payload* wait_until(const std::chrono::time_point<ClockT, DurationT>& deadline)
+            {
+                auto& parked = timed_waiters::get();
+
+                std::shared_ptr<base_task_payload> hold;
+
+                base_task_payload* current = this;
+                while (true)
+                {
+                    if (!current->m_completed)
+                    {
+                        parked.count++;
+                        auto unpark = gsl::finally([&parked] { parked.count--; });
+
+                        std::unique_lock<std::mutex> lock{ parked.mutex };
+                        if (!parked.condition.wait_until(lock, deadline, [current] { return current->completed(); }))
+                            return nullptr;
+                    }
+
+                    auto redirect = current->redirect();
+                    if (!redirect)
+                        return current;
+
+                    hold = std::move(redirect);
+                    current = hold.get();
+                }
+            }
+
         private:
+            std::shared_ptr<base_task_payload> redirect()
+            {
+                std::lock_guard<std::mutex> guard{ m_mutex };
+                return m_taskRedirect;
+            }
+
             std::variant<continuation_payload, std::vector<continuation_payload>> cannibalize(std::shared_ptr<base_task_payload> taskRedirect)
             {
+                auto wake = gsl::finally([this] { notify_waiters(); });
+
                 std::lock_guard<std::mutex> guard{ m_mutex };
 
                 if (m_completed)
@@ -147,6 +277,43 @@ namespace arcana
                 return std::move(m_continuation);
             }
 
+            void notify_waiters()
+            {
+                if (!m_completed)
+                    return;
+
+                m_completed.notify_all();
+
+                auto& parked = timed_waiters::get();
+                if (parked.count != 0)
+                {
+                    // taking the lock makes sure a parked waiter is either
+                    // already waiting or hasn't checked for completion yet
+                    {
+                        std::lock_guard<std::mutex> guard{ parked.mutex };
+                    }
+                    parked.condition.notify_all();
+                }
+            }
+
+            //
+            // std::atomic::wait has no timeout, so timed waits park on a condition
+            // variable shared by all tasks which completions only notify when
+            // someone is actually parked on it.
+            //
+            struct timed_waiters
+            {
+                std::mutex mutex;
+                std::condition_variable condition;
+                std::atomic<size_t> count{ 0 };
+
+                static timed_waiters& get()
+                {
+                    static timed_waiters instance;
+                    return instance;
+                }
+            };
+
             static gsl::span<continuation_payload> continuation_span(std::variant<continuation_payload, std::vector<continuation_payload>>& either)
             {
                 if (auto vect = std::get_if<1>(&either))
@@ -188,39 +355,153 @@ namespace arcana
 
                 bool runit = false;
 
+                // Follow the forwarding addresses (see m_taskRedirect) one payload at a time
+                // so we never hold more than one mutex, and remember the payloads we went through
+                // so they can point straight to the final task once we're done.
+                std::shared_ptr<base_task_payload> target;
+                std::vector<std::shared_ptr<base_task_payload>> skipped;
+
+                for (base_task_payload* current = this;;)
                 {
-                    std::lock_guard<std::mutex> guard{ m_mutex };
+                    std::unique_lock<std::mutex> guard{ current->m_mutex };
+
+                    if (current->m_taskRedirect)
+                    {
+                        if (target)
+                            skipped.push_back(std::move(target));
+
+                        target = current->m_taskRedirect;
+                        current = target.get();
+                        continue;
+                    }
 
-                    if (m_taskRedirect)
+                    // continuations read their result from the task we got forwarded to
+                    if (target)
                     {
-                        m_taskRedirect->add_continuations(continuations, m_taskRedirect);
+                        for (auto& continuation : continuations)
+                            continuation.reparent(target);
+                    }
+
+                    if (current->m_completed)
+                    {
+                        runit = true;
                     }
                     else
                     {
-                        if (m_completed)
-                        {
-                            runit = true;
-                        }
-                        else
-                        {
-                            internal_add_continuations(continuations);
-                        }
+                        current->internal_add_continuations(continuations);
                     }
+
+                    break;
+                }
+
+                // path compression, the next lookup from any of these is a single hop
+                if (!skipped.empty())
+                {
+                    redirect_to(*this, target);
+
+                    for (auto& payload : skipped)
+                        redirect_to(*payload, target);
                 }
 
                 if (runit)
                 {
-                    for (auto& continuation : continuations)
-                        continuation.run();
+                    run_continuations(continuations);
                 }
             }
 
+            //
+            // Points an already redirected payload to a task further down its redirect chain.
+            //
+            static void redirect_to(base_task_payload& payload, const std::shared_ptr<base_task_payload>& target)
+            {
+                // released outside of the lock as it might be the last reference to an intermediate task
+                std::shared_ptr<base_task_payload> previous;
+
+                std::lock_guard<std::mutex> guard{ payload.m_mutex };
+
+                if (payload.m_taskRedirect)
+                    previous = std::exchange(payload.m_taskRedirect, target);
+            }
+
             void do_completion()
             {
+#ifdef ARCANA_TASK_HOOKS
+                m_tracker.completed();
+#endif
                 std::variant<continuation_payload, std::vector<continuation_payload>> continuation = cannibalize(nullptr);
 
-                for (auto& callable : continuation_span(continuation))
-                    callable.run();
+                run_continuations(continuation_span(continuation));
+            }
+
+            //
+            // When tasks complete synchronously their continuations run recursively
+            // (completion -> continuation -> scheduler -> continuation completion -> ...)
+            // so a long chain on the inline_scheduler grows the stack with the length of the chain.
+            // To bound that, each thread keeps a trampoline: once max_depth completions are nested
+            // on the stack, further continuations get parked and the outermost completion
+            // runs them in a loop once the stack has unwound.
+            //
+            // Parked continuations hold on to their parent, otherwise it could
+            // be destroyed as the stack unwinds before they get to read its result.
+            struct trampoline
+            {
+                static constexpr size_t max_depth = 64;
+
+                size_t depth = 0;
+                std::deque<std::pair<std::shared_ptr<base_task_payload>, continuation_payload>> parked;
+            };
+
+            static trampoline& current_trampoline()
+            {
+                thread_local trampoline instance;
+                return instance;
+            }
+
+            static void run_continuations(gsl::span<continuation_payload> continuations)
+            {
+                if (continuations.empty())
+                    return;
+
+                trampoline& tramp = current_trampoline();
+
+                if (tramp.depth >= trampoline::max_depth)
+                {
+                    for (auto& continuation : continuations)
+                        tramp.parked.emplace_back(continuation.lock_parent(), std::move(continuation));
+
+                    return;
+                }
+
+                {
+                    ++tramp.depth;
+                    auto restore = gsl::finally([&tramp] { --tramp.depth; });
+
+                    for (auto& continuation : continuations)
+                        continuation.run();
+                }
+
+                if (tramp.depth == 0)
+                {
+                    run_parked(tramp);
+                }
+            }
+
+            //
+            // Called by the outermost completion on this thread to run what got parked
+            // while the stack was deep. Running a parked continuation can park more.
+            //
+            static void run_parked(trampoline& tramp)
+            {
+                while (!tramp.parked.empty())
+                {
+                    auto parked = std::move(tramp.parked.front());
+                    tramp.parked.pop_front();
+
+                    ++tramp.depth;
+                    auto restore = gsl::finally([&tramp] { --tramp.depth; });
+
+                    parked.second.run();
+                }
             }
 
             void internal_add_continuations(continuation_payload&& continuation)
@@ -269,7 +550,7 @@ namespace arcana
             std::mutex m_mutex;
 
         private:
-            bool m_completed = false;
+            std::atomic<bool> m_completed{ false };
             work_function_t m_work = nullptr;
             std::variant<continuation_payload, std::vector<continuation_payload>> m_continuation{ continuation_payload{} };
 
@@ -285,6 +566,11 @@ namespace arcana
             // original task_completion_source. The m_taskRedirect task is then where we add the continuation instead
             // of the task_completion_source.
             std::shared_ptr<base_task_payload> m_taskRedirect;
+
+#ifdef ARCANA_TASK_HOOKS
+        public:
+            task_hooks::detail::task_tracker m_tracker;
+#endif
         };
 
         template<typename ResultT, typename ErrorT>
@@ -313,6 +599,18 @@ namespace arcana
 
                 base_task_payload::complete();
             }
+
+            //
+            // Returns the result of this task if it's already completed, or null if it isn't
+            // (or if it got redirected, in which case the result lives in another task).
+            //
+            const basic_expected<ResultT, ErrorT>* ready_result() const
+            {
+                if (!completed() || !Result.has_value())
+                    return nullptr;
+
+                return &*Result;
+            }
         };
 
         template<typename ResultT, typename ErrorT, size_t WorkSize>
@@ -350,11 +648,19 @@ namespace arcana
         {
             using task_t = task<ReturnT, ErrorT>;
 
+            // whether a task can be returned directly from an already known result
+            static constexpr bool supports_ready = true;
+
             task_factory(std::shared_ptr<task_payload_with_return<ReturnT, ErrorT>> payload)
                 : to_run{ std::move(payload) }
                 , to_return{ to_run }
             {}
 
+            static task_t from_ready(basic_expected<ReturnT, ErrorT>&& result)
+            {
+                return make_ready_task(std::move(result));
+            }
+
             task_t to_run;
             task_t to_return;
         };
@@ -366,6 +672,19 @@ namespace arcana
 
             using task_t = task<TaskReturnT, largest_error>;
 
+            // an already known inner task can only be handed out as is if it has the right error type
+            static constexpr bool supports_ready = std::is_same<TaskErrorT, largest_error>::value;
+
+            static task_t from_ready(basic_expected<task<TaskReturnT, TaskErrorT>, ErrorT>&& result)
+            {
+                if (result.has_error())
+                {
+                    return make_ready_task(basic_expected<TaskReturnT, largest_error>{ make_unexpected(result.error()) });
+                }
+
+                return std::move(result.value());
+            }
+
             task_factory(std::shared_ptr<task_payload_with_return<task<TaskReturnT, TaskErrorT>, ErrorT>> payload)
                 : to_run{ std::move(payload) }
             {
@@ -400,8 +719,8 @@ namespace arcana
                         // The downside of the forwarding task is that if you keep a top level
                         // stand-in completion source around and call .then() on it after unwrapping
                         // you'll have to walk a potentially unbounded chain of forwarding tasks.
-                        // Thankfully in all our scenarios that use infinite recursive tasks we immediately
-                        // add a continuation to it and then await cancellation when we're done.
+                        // add_continuations compresses that chain as it walks it, so only the first
+                        // .then() after a long run of unwrapping pays for it.
                         //
                         // One can think of this system like a platformer where the character
                         // is running on a platform that is advancing using pieces from its tail.
@@ -2,7 +2,12 @@
 
 #include "task.h"
 
-#include <vector>
+#include <atomic>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <type_traits>
 
 namespace arcana
 {
@@ -10,6 +15,18 @@ namespace arcana
     class pending_task_scope
     {
     public:
+        pending_task_scope() = default;
+
+        //
+        // Creates a scope that lets at most maxInFlight admitted tasks run at once.
+        // Tasks added with += aren't subject to the limit.
+        //
+        explicit pending_task_scope(size_t maxInFlight)
+            : m_maxInFlight{ maxInFlight }
+        {
+            assert(maxInFlight > 0 && "a pending task scope needs to let at least one task run");
+        }
+
         template<typename ResultT>
         task<ResultT, ErrorT>& operator+=(task<ResultT, ErrorT>&& task)
         {
@@ -19,45 +36,47 @@ namespace arcana
         template<typename ResultT>
         task<ResultT, ErrorT>& operator+=(task<ResultT, ErrorT>& task)
         {
-            {
-                std::lock_guard<std::mutex> guard{ m_mutex };
-                if (m_disposing)
-                    throw std::runtime_error("can't add tasks to a pending scope once it starts disposing itself");
-
-                m_pending++;
-            }
+            begin();
 
             task.then(inline_scheduler, cancellation::none(), [this](const basic_expected<ResultT, ErrorT>& result) noexcept
             {
-                bool complete = false;
-                {
-                    std::lock_guard<std::mutex> guard{ m_mutex };
-                    m_pending--;
-
-                    complete = m_disposing && m_pending == 0;
-
-                    // If this failed and is the first error, copy that error
-                    // as further errors are likely due to cascading failures.
-                    if (result.has_error() && !m_error)
-                    {
-                        m_error = result.error();
-                    }
-
-                    if (complete)
-                    {
-                        m_setcompletion = true;
-                    }
-                }
+                end(result);
+                return arcana::expected<void, ErrorT>::make_valid();
+            });
 
-                if (complete)
-                {
-                    complete_internal();
-                }
+            return task;
+        }
+
+        //
+        // Adds the task returned by the factory to the scope, deferring the call to the
+        // factory until fewer than max_in_flight admitted tasks are running. The factory
+        // must return a task<ResultT, ErrorT> and ends up being called either right away
+        // or inline on the thread that completes the task whose slot it takes over.
+        //
+        template<typename FactoryT>
+        auto admit(FactoryT&& factory)
+        {
+            using task_t = std::invoke_result_t<FactoryT&>;
+            using result_t = typename task_t::result_type;
+
+            // continuations of std::exception_ptr tasks can't be noexcept
+            constexpr bool nothrow = !std::is_same<ErrorT, std::exception_ptr>::value;
+
+            begin();
 
+            task_t started = acquire().then(inline_scheduler, cancellation::none(), [factory = std::forward<FactoryT>(factory)]() mutable noexcept(nothrow)
+            {
+                return factory();
+            });
+
+            started.then(inline_scheduler, cancellation::none(), [this](const basic_expected<result_t, ErrorT>& result) noexcept
+            {
+                release();
+                end(result);
                 return arcana::expected<void, ErrorT>::make_valid();
             });
 
-            return task;
+            return started;
         }
 
         bool completed() const noexcept
@@ -67,7 +86,7 @@ namespace arcana
 
         bool has_error() const noexcept
         {
-            return static_cast<bool>(m_error);
+            return m_errorState.load(std::memory_order_acquire) == error_state::published;
         }
 
         const ErrorT& error() const noexcept
@@ -75,18 +94,21 @@ namespace arcana
             return m_error;
         }
 
+        size_t max_in_flight() const noexcept
+        {
+            return m_maxInFlight;
+        }
+
         task<void, ErrorT> when_all()
         {
+            // Both this and the last task to complete can see the scope drained,
+            // m_setcompletion makes sure only one of them completes it.
+            m_disposing = true;
+            if (m_pending == 0 && !m_setcompletion.exchange(true))
             {
-                std::lock_guard<std::mutex> guard{ m_mutex };
-
-                m_disposing = true;
-                if (m_pending == 0 && !m_setcompletion)
-                {
-                    m_setcompletion = true;
-                    complete_internal();
-                }
+                complete_internal();
             }
+
             return m_completed.as_task();
         }
 
@@ -97,9 +119,52 @@ namespace arcana
         }
 
     private:
+        enum class error_state
+        {
+            none,
+            claimed,
+            published
+        };
+
+        void begin()
+        {
+            // Count the task before checking for disposal so that a concurrent
+            // when_all either sees it pending or we see it disposing.
+            m_pending++;
+
+            if (m_disposing)
+            {
+                end(basic_expected<void, ErrorT>::make_valid());
+                throw std::runtime_error("can't add tasks to a pending scope once it starts disposing itself");
+            }
+        }
+
+        template<typename ResultT>
+        void end(const basic_expected<ResultT, ErrorT>& result) noexcept
+        {
+            // If this failed and is the first error, copy that error
+            // as further errors are likely due to cascading failures.
+            // The error gets published before the task stops counting
+            // as pending so whoever completes the scope sees it.
+            if (result.has_error())
+            {
+                auto expected = error_state::none;
+                if (m_errorState.compare_exchange_strong(expected, error_state::claimed))
+                {
+                    m_error = result.error();
+                    m_errorState.store(error_state::published, std::memory_order_release);
+                }
+            }
+
+            if (--m_pending == 0 && m_disposing && !m_setcompletion.exchange(true))
+            {
+                complete_internal();
+            }
+        }
+
         void complete_internal()
         {
-            if (m_error)
+            if (has_error())
             {
                 m_completed.complete(make_unexpected(m_error));
             }
@@ -109,11 +174,74 @@ namespace arcana
             }
         }
 
-        mutable std::mutex m_mutex;
-        int m_pending = 0;
-        bool m_disposing = false;
-        bool m_setcompletion = false;
+        bool try_acquire() noexcept
+        {
+            size_t inFlight = m_inFlight.load();
+            while (inFlight < m_maxInFlight)
+            {
+                if (m_inFlight.compare_exchange_weak(inFlight, inFlight + 1))
+                    return true;
+            }
+
+            return false;
+        }
+
+        task<void, ErrorT> acquire()
+        {
+            if (try_acquire())
+                return task_from_result<ErrorT>();
+
+            std::lock_guard<std::mutex> guard{ m_waitersMutex };
+
+            // Announce the wait before trying again, release() frees the slot before
+            // checking for waiters so one of the two is guaranteed to see the other.
+            m_waiting++;
+            if (try_acquire())
+            {
+                m_waiting--;
+                return task_from_result<ErrorT>();
+            }
+
+            return m_waiters.emplace_back().as_task();
+        }
+
+        void release() noexcept
+        {
+            m_inFlight--;
+
+            if (m_waiting == 0)
+                return;
+
+            std::optional<task_completion_source<void, ErrorT>> next;
+            {
+                std::lock_guard<std::mutex> guard{ m_waitersMutex };
+
+                if (!m_waiters.empty() && try_acquire())
+                {
+                    next.emplace(std::move(m_waiters.front()));
+                    m_waiters.pop_front();
+                    m_waiting--;
+                }
+            }
+
+            // runs the next factory inline, outside of the lock
+            if (next)
+            {
+                next->complete();
+            }
+        }
+
+        std::atomic<int> m_pending{ 0 };
+        std::atomic<bool> m_disposing{ false };
+        std::atomic<bool> m_setcompletion{ false };
+        std::atomic<error_state> m_errorState{ error_state::none };
         task_completion_source<void, ErrorT> m_completed;
         ErrorT m_error;
+
+        const size_t m_maxInFlight = std::numeric_limits<size_t>::max();
+        std::atomic<size_t> m_inFlight{ 0 };
+        std::atomic<size_t> m_waiting{ 0 };
+        std::mutex m_waitersMutex;
+        std::deque<task_completion_source<void, ErrorT>> m_waiters;
     };
 }
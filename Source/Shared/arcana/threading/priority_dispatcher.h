@@ -0,0 +1,328 @@
+#pragma once
+
+#include "arcana/functional/inplace_function.h"
+
+#include "affinity.h"
+#include "blocking_concurrent_queue.h"
+#include "cancellation.h"
+#include "dispatcher.h"
+#include "dispatcher_metrics.h"
+
+#include <gsl/gsl>
+
+#include <array>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace arcana
+{
+    enum class priority : size_t
+    {
+        high = 0,
+        normal = 1,
+        low = 2
+    };
+
+    //
+    // Dispatcher with a queue per priority level, level 0 being the most urgent.
+    //
+    // Like dispatcher, a tick drains a snapshot of the queued work, here taken from every level,
+    // and work queued while it runs waits for the next tick. The snapshot runs in weighted rounds,
+    // each round taking up to 2^(Levels - 1 - level) work items from every level, so higher levels
+    // get most of the thread without starving lower ones.
+    //
+    // WaitPolicy and MetricsT work the same way they do for dispatcher.
+    //
+    template<size_t WorkSize, size_t Levels = 3, typename WaitPolicy = park_wait_policy, typename MetricsT = no_dispatcher_metrics>
+    class priority_dispatcher
+    {
+        static_assert(Levels > 0, "a priority dispatcher needs at least one level");
+        static_assert(Levels <= std::numeric_limits<size_t>::digits, "the weight of the lowest level has to fit in a size_t");
+
+    public:
+        using callback_t = stdext::inplace_function<void(), WorkSize>;
+        using wait_policy = WaitPolicy;
+        static constexpr size_t work_size = WorkSize;
+        static constexpr size_t levels = Levels;
+        static constexpr bool collects_metrics = !std::is_same<MetricsT, no_dispatcher_metrics>::value;
+
+        //
+        // Scheduler that queues its work on one level of the dispatcher.
+        //
+        class level_scheduler
+        {
+        public:
+            template<typename T>
+            void queue(T&& work)
+            {
+                m_dispatcher.queue(m_level, std::forward<T>(work));
+            }
+
+            template<typename T>
+            void operator()(T&& work)
+            {
+                queue(std::forward<T>(work));
+            }
+
+            affinity get_affinity() const
+            {
+                return m_dispatcher.get_affinity();
+            }
+
+            size_t level() const
+            {
+                return m_level;
+            }
+
+        private:
+            friend class priority_dispatcher;
+
+            level_scheduler(priority_dispatcher& dispatcher, size_t level)
+                : m_dispatcher{ dispatcher }
+                , m_level{ level }
+            {}
+
+            priority_dispatcher& m_dispatcher;
+            size_t m_level;
+        };
+
+        level_scheduler& at(size_t level)
+        {
+            GSL_CONTRACT_CHECK("priority level", level < Levels);
+            return m_schedulers[level];
+        }
+
+        level_scheduler& at(priority level)
+        {
+            static_assert(Levels >= 3, "arcana::priority needs a dispatcher with at least 3 levels");
+            return at(static_cast<size_t>(level));
+        }
+
+        //
+        // Queues work on the middle level.
+        //
+        template<typename T>
+        void queue(T&& work)
+        {
+            queue(Levels / 2, std::forward<T>(work));
+        }
+
+        template<typename T>
+        void queue(size_t level, T&& work)
+        {
+            GSL_CONTRACT_CHECK("priority level", level < Levels);
+
+            if constexpr (collects_metrics)
+            {
+                m_levels[level].push(work_t{ callback_t{ std::forward<T>(work) }, dispatcher_metrics::clock::now() });
+                m_metrics.queued(depth());
+            }
+            else
+            {
+                m_levels[level].push(work_t{ callback_t{ std::forward<T>(work) } });
+            }
+
+            // the levels are only drained once the signal is taken, so work is never
+            // left behind by a tick that took the signal pushed for it
+            m_signal.push(true);
+        }
+
+        template<typename T>
+        void operator()(T&& work)
+        {
+            queue(std::forward<T>(work));
+        }
+
+        affinity get_affinity() const
+        {
+            return m_affinity;
+        }
+
+        //
+        // Can be called from any thread, including while the dispatcher is ticking.
+        // The depth is the number of work items queued over all the levels.
+        //
+        dispatcher_metrics_snapshot metrics() const
+        {
+            static_assert(collects_metrics, "metrics are only available with the dispatcher_metrics policy");
+            return m_metrics.snapshot(depth());
+        }
+
+        void reset_metrics()
+        {
+            static_assert(collects_metrics, "metrics are only available with the dispatcher_metrics policy");
+            m_metrics.reset();
+        }
+
+        priority_dispatcher(const priority_dispatcher&) = delete;
+        priority_dispatcher& operator=(const priority_dispatcher&) = delete;
+
+        virtual ~priority_dispatcher() = default;
+
+    protected:
+        priority_dispatcher()
+            : m_schedulers{ make_schedulers(std::make_index_sequence<Levels>{}) }
+        {}
+
+        bool tick(const cancellation& token)
+        {
+            return internal_tick(token, false);
+        }
+
+        bool blocking_tick(const cancellation& token)
+        {
+            return internal_tick(token, true);
+        }
+
+        /*
+        Sets the dispatcher's tick thread affinity. Once this is set the methods
+        on this instance will need to be called by that thread.
+        */
+        void set_affinity(const affinity& aff)
+        {
+            m_affinity = aff;
+        }
+
+        void cancelled()
+        {
+            m_signal.cancelled();
+        }
+
+        void clear()
+        {
+            for (auto& level : m_levels)
+            {
+                level.clear();
+            }
+
+            m_signal.clear();
+        }
+
+    private:
+        using work_t = internal::queued_work<callback_t, false, collects_metrics>;
+
+        template<size_t... Level>
+        std::array<level_scheduler, Levels> make_schedulers(std::index_sequence<Level...>)
+        {
+            return { level_scheduler{ *this, Level }... };
+        }
+
+        static constexpr size_t weight(size_t level)
+        {
+            return size_t{ 1 } << (Levels - 1 - level);
+        }
+
+        size_t depth() const
+        {
+            size_t depth = 0;
+            for (auto& level : m_levels)
+            {
+                depth += level.size();
+            }
+
+            return depth;
+        }
+
+        bool internal_tick(const cancellation& token, bool block)
+        {
+            GSL_CONTRACT_CHECK("thread affinity", m_affinity.check());
+
+            bool signaled;
+            if (block)
+            {
+                if (!m_signal.blocking_pop(signaled, token))
+                    return false;
+            }
+            else
+            {
+                if (!m_signal.try_pop(signaled, token))
+                    return false;
+            }
+
+            size_t remaining = 0;
+            for (size_t level = 0; level < Levels; ++level)
+            {
+                m_levels[level].try_drain(m_workloads[level], cancellation::none());
+                remaining += m_workloads[level].size();
+            }
+
+            // the signal can outlive its work, which an earlier tick might have drained already
+            if (remaining == 0)
+                return false;
+
+            [[maybe_unused]] const auto tickStart = collects_metrics ? dispatcher_metrics::clock::now() : dispatcher_metrics::clock::time_point{};
+
+            std::array<size_t, Levels> next{};
+            while (remaining > 0)
+            {
+                for (size_t level = 0; level < Levels; ++level)
+                {
+                    auto& workload = m_workloads[level];
+                    for (size_t count = weight(level); count > 0 && next[level] < workload.size(); --count, --remaining)
+                    {
+                        run(workload[next[level]++]);
+                    }
+                }
+            }
+
+            if constexpr (collects_metrics)
+            {
+                m_metrics.ticked(dispatcher_metrics::clock::now() - tickStart);
+            }
+
+            for (auto& workload : m_workloads)
+            {
+                workload.clear();
+            }
+
+            return true;
+        }
+
+        void run(work_t& item)
+        {
+            if constexpr (collects_metrics)
+            {
+                m_metrics.started(dispatcher_metrics::clock::now() - item.queued);
+            }
+
+            item.work();
+        }
+
+        std::array<level_scheduler, Levels> m_schedulers;
+
+        // the levels are only ever drained, ticks block on the signal instead
+        std::array<blocking_concurrent_queue<work_t>, Levels> m_levels;
+        blocking_concurrent_queue<bool, 1, WaitPolicy> m_signal;
+
+        affinity m_affinity;
+        std::array<std::vector<work_t>, Levels> m_workloads;
+        [[no_unique_address]] MetricsT m_metrics;
+    };
+
+    template<size_t WorkSize, size_t Levels = 3, typename WaitPolicy = park_wait_policy, typename MetricsT = no_dispatcher_metrics>
+    class manual_priority_dispatcher : public priority_dispatcher<WorkSize, Levels, WaitPolicy, MetricsT>
+    {
+    public:
+        using priority_dispatcher<WorkSize, Levels, WaitPolicy, MetricsT>::blocking_tick;
+        using priority_dispatcher<WorkSize, Levels, WaitPolicy, MetricsT>::cancelled;
+        using priority_dispatcher<WorkSize, Levels, WaitPolicy, MetricsT>::clear;
+        using priority_dispatcher<WorkSize, Levels, WaitPolicy, MetricsT>::set_affinity;
+        using priority_dispatcher<WorkSize, Levels, WaitPolicy, MetricsT>::tick;
+    };
+
+    template<size_t WorkSize, size_t Levels = 3, typename WaitPolicy = park_wait_policy, typename MetricsT = no_dispatcher_metrics>
+    class background_priority_dispatcher : public internal::background_thread<priority_dispatcher<WorkSize, Levels, WaitPolicy, MetricsT>>
+    {
+    public:
+        background_priority_dispatcher()
+            : background_priority_dispatcher([] {})
+        {}
+
+        template<typename InitT>
+        explicit background_priority_dispatcher(InitT&& init)
+            : internal::background_thread<priority_dispatcher<WorkSize, Levels, WaitPolicy, MetricsT>>{ std::forward<InitT>(init) }
+        {}
+    };
+}
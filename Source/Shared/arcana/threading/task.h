@@ -8,6 +8,7 @@
 #include "cancellation.h"
 
 #include <gsl/gsl>
+#include <chrono>
 #include <memory>
 #include <stdexcept>
 
@@ -102,9 +103,32 @@ namespace arcana
             static_assert(std::is_same_v<typename expected_error_or<typename traits::input_type, error_type>::type, error_type>,
                 "Continuation expected input parameter needs to use the same error type as the parent task");
 
+            using return_type = typename traits::expected_return_type::value_type;
+            using factory_t = internal::task_factory<typename traits::error_propagation_type, return_type>;
+
+            auto work = wrapper::wrap_callable(std::forward<CallableT>(callable), token);
+
+            // An inline continuation on a task that already completed can produce its result
+            // right away, without registering a continuation or allocating a work payload.
+            // It still counts against the trampoline, past which it takes the regular path
+            // below so that recursive chains of ready tasks don't overflow the stack.
+            if constexpr (internal::elides_ready_payloads &&
+                internal::is_inline_scheduler<SchedulerT>::value &&
+                factory_t::supports_ready)
+            {
+                if (auto ready = m_payload->ready_result())
+                {
+                    typename factory_t::task_t result;
+                    if (internal::base_task_payload::run_inline([&] { result = factory_t::from_ready(work(*ready)); }))
+                    {
+                        return result;
+                    }
+                }
+            }
+
             auto factory{ internal::make_task_factory(
-                internal::make_work_payload<typename traits::expected_return_type::value_type, typename traits::error_propagation_type>(
-                    [callable = wrapper::wrap_callable(std::forward<CallableT>(callable), token)]
+                internal::make_work_payload<return_type, typename traits::error_propagation_type>(
+                    [callable = std::move(work)]
                     (internal::base_task_payload* self) mutable noexcept
                     {
                         return callable(*static_cast<payload_t*>(self)->Result);
@@ -119,11 +143,75 @@ namespace arcana
             return factory.to_return;
         }
 
+        //
+        // Blocks the calling thread until this task completes.
+        //
+        // Blocking on a thread that the task needs in order to make progress (like the thread
+        // ticking a dispatcher one of its continuations runs on) deadlocks, use wait(dispatcher) there.
+        //
+        void wait() const
+        {
+            m_payload->wait();
+        }
+
+        //
+        // Blocks the calling thread until this task completes or the timeout expires.
+        // Returns whether the task completed.
+        //
+        template<typename RepT, typename PeriodT>
+        bool wait_for(const std::chrono::duration<RepT, PeriodT>& timeout) const
+        {
+            return m_payload->wait_until(std::chrono::steady_clock::now() + timeout) != nullptr;
+        }
+
+        //
+        // Blocks the calling thread until this task completes, running the work queued
+        // on the given dispatcher in the meantime. Use this to block the thread that ticks a
+        // dispatcher (e.g. a manual_dispatcher) which the task might depend on.
+        //
+        template<typename DispatcherT>
+        void wait(DispatcherT& dispatcher) const
+        {
+            while (!wait_for(std::chrono::steady_clock::duration::zero()))
+            {
+                if (!dispatcher.tick(cancellation::none()))
+                {
+                    wait_for(std::chrono::milliseconds{ 1 });
+                }
+            }
+        }
+
+        //
+        // Blocks the calling thread until this task completes and returns its result.
+        //
+        basic_expected<ResultT, ErrorT> get() const
+        {
+            return *static_cast<payload_t&>(m_payload->wait()).Result;
+        }
+
     private:
         explicit task(payload_ptr payload)
             : m_payload{ std::move(payload) }
         {}
 
+        static payload_ptr make_completed_payload(basic_expected<ResultT, ErrorT> result)
+        {
+            auto payload = std::make_shared<payload_t>();
+            payload->complete(std::move(result));
+            return payload;
+        }
+
+        //
+        // Successful ready void tasks have nothing to tell apart, so they all share this payload.
+        // Continuations never modify a completed payload, and it's never destroyed so that
+        // ready tasks can still be used while static objects get destroyed.
+        //
+        static const payload_ptr& shared_completed_payload()
+        {
+            static const payload_ptr* payload = new payload_ptr{ make_completed_payload(basic_expected<void, ErrorT>::make_valid()) };
+            return *payload;
+        }
+
         template<typename OtherResultT, typename OtherErrorT>
         friend class task;
 
@@ -132,6 +220,9 @@ namespace arcana
         template<typename OtherErrorT, typename OtherResultT>
         friend struct internal::task_factory;
 
+        template<typename OtherResultT, typename OtherErrorT>
+        friend task<OtherResultT, OtherErrorT> internal::make_ready_task(basic_expected<OtherResultT, OtherErrorT> result);
+
         template<typename SchedulerT, typename CallableT>
         friend auto make_task(SchedulerT& scheduler, cancellation& token, CallableT&& callable)
             -> typename internal::task_factory<
@@ -140,6 +231,23 @@ namespace arcana
 
         payload_ptr m_payload;
     };
+
+    namespace internal
+    {
+        template<typename ResultT, typename ErrorT>
+        inline task<ResultT, ErrorT> make_ready_task(basic_expected<ResultT, ErrorT> result)
+        {
+            if constexpr (elides_ready_payloads && std::is_void<ResultT>::value)
+            {
+                if (!result.has_error())
+                {
+                    return task<ResultT, ErrorT>{ task<ResultT, ErrorT>::shared_completed_payload() };
+                }
+            }
+
+            return task<ResultT, ErrorT>{ task<ResultT, ErrorT>::make_completed_payload(std::move(result)) };
+        }
+    }
 }
 
 namespace arcana
@@ -280,6 +388,9 @@ namespace arcana
                 })
         ) };
 
+#ifdef ARCANA_TASK_HOOKS
+        factory.to_run.m_payload->m_tracker.scheduled();
+#endif
         scheduler([to_run = std::move(factory.to_run)]
         {
             to_run.m_payload->run(nullptr);
@@ -294,41 +405,32 @@ namespace arcana
     template<typename ErrorT, typename ResultT>
     inline task<typename as_expected<ResultT, ErrorT>::value_type, ErrorT> task_from_result(ResultT&& value)
     {
-        task_completion_source<typename as_expected<ResultT, ErrorT>::value_type, ErrorT> result;
-        result.complete(std::forward<ResultT>(value));
-        return result;
+        return internal::make_ready_task(
+            typename as_expected<ResultT, ErrorT>::type{ std::forward<ResultT>(value) });
     }
 
     template<typename ErrorT>
     inline task<void, ErrorT> task_from_result()
     {
-        task_completion_source<void, ErrorT> result;
-        result.complete();
-        return result;
+        return internal::make_ready_task(basic_expected<void, ErrorT>::make_valid());
     }
 
     template<typename ResultT, typename ErrorT>
     inline task<ResultT, std::error_code> task_from_error(const ErrorT& error)
     {
-        task_completion_source<ResultT, std::error_code> result;
-        result.complete(make_unexpected(make_error_code(error)));
-        return result;
+        return internal::make_ready_task(basic_expected<ResultT, std::error_code>{ make_unexpected(make_error_code(error)) });
     }
 
     template<typename ResultT>
     inline task<ResultT, std::error_code> task_from_error(const std::error_code& error)
     {
-        task_completion_source<ResultT, std::error_code> result;
-        result.complete(make_unexpected(error));
-        return result;
+        return internal::make_ready_task(basic_expected<ResultT, std::error_code>{ make_unexpected(error) });
     }
 
     template<typename ResultT>
     inline task<ResultT, std::exception_ptr> task_from_error(const std::exception_ptr& error)
     {
-        task_completion_source<ResultT, std::exception_ptr> result;
-        result.complete(make_unexpected(error));
-        return result;
+        return internal::make_ready_task(basic_expected<ResultT, std::exception_ptr>{ make_unexpected(error) });
     }
 
     template<typename ErrorT>
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+namespace arcana::task_hooks
+{
+    //
+    // Task lifecycle instrumentation, compiled into the task payloads when ARCANA_TASK_HOOKS
+    // is defined. Without it this header is never included by the task system and tasks
+    // carry no instrumentation at all.
+    //
+    // Every task payload gets a record that a sink gets notified with as the task goes through
+    // its lifecycle: created, scheduled (handed to its scheduler), started (its scheduler
+    // runs it) and completed. Timestamps of the steps that haven't happened yet, or that
+    // happened while no sink was installed, are left default constructed. Task completion
+    // sources are never scheduled nor started, they only get created and completed.
+    //
+    using clock = std::chrono::steady_clock;
+
+    struct task_record
+    {
+        uint64_t id;
+        const char* name;
+        clock::time_point created;
+        clock::time_point scheduled;
+        clock::time_point started;
+        clock::time_point completed;
+    };
+
+    //
+    // Receives task lifecycle events. Hooks get called concurrently from whichever thread
+    // the task goes through the step on, so implementations have to be thread safe.
+    //
+    class sink
+    {
+    public:
+        virtual ~sink() = default;
+
+        virtual void on_created(const task_record&) {}
+        virtual void on_scheduled(const task_record&) {}
+        virtual void on_started(const task_record&) {}
+        virtual void on_completed(const task_record&) {}
+    };
+
+    namespace detail
+    {
+        inline std::atomic<sink*> current_sink{ nullptr };
+        inline std::atomic<uint64_t> next_id{ 1 };
+        inline thread_local const char* current_name{ nullptr };
+    }
+
+    //
+    // Installs the sink that gets notified of task lifecycle events, or none when null.
+    // Tasks can still be reporting to the previous sink while it's getting replaced, so
+    // it has to stay alive until the tasks that were running at that point are done.
+    //
+    inline void set_sink(sink* value)
+    {
+        detail::current_sink.store(value, std::memory_order_release);
+    }
+
+    inline sink* get_sink()
+    {
+        return detail::current_sink.load(std::memory_order_acquire);
+    }
+
+    //
+    // Names the tasks created on the current thread while it's alive, continuations
+    // included. The name has to outlive the tasks, string literals are a good fit.
+    //
+    //   arcana::task_hooks::name_scope scope{ "decode_texture" };
+    //   make_task(background, cancel, [] { ... }).then(...);
+    //
+    class name_scope
+    {
+    public:
+        explicit name_scope(const char* name)
+            : m_previous{ std::exchange(detail::current_name, name) }
+        {}
+
+        name_scope(const name_scope&) = delete;
+        name_scope& operator=(const name_scope&) = delete;
+
+        ~name_scope()
+        {
+            detail::current_name = m_previous;
+        }
+
+    private:
+        const char* m_previous;
+    };
+
+    //
+    // Histogram of durations with power of two buckets, bucket i counting
+    // durations between 2^i and 2^(i+1) nanoseconds.
+    //
+    class latency_histogram
+    {
+    public:
+        static constexpr size_t bucket_count = 64;
+
+        void record(clock::duration duration)
+        {
+            const auto nanoseconds = static_cast<uint64_t>(std::max<int64_t>(0,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+
+            m_buckets[nanoseconds == 0 ? 0 : std::bit_width(nanoseconds) - 1]++;
+            m_count++;
+            m_total += nanoseconds;
+            m_max = std::max(m_max, nanoseconds);
+        }
+
+        uint64_t count() const
+        {
+            return m_count;
+        }
+
+        std::chrono::nanoseconds total() const
+        {
+            return std::chrono::nanoseconds{ m_total };
+        }
+
+        std::chrono::nanoseconds max() const
+        {
+            return std::chrono::nanoseconds{ m_max };
+        }
+
+        //
+        // Upper bound of the bucket the given percentile (between 0 and 1) falls in.
+        //
+        std::chrono::nanoseconds percentile(double fraction) const
+        {
+            const auto target = static_cast<uint64_t>(std::clamp(fraction, 0.0, 1.0) * m_count);
+
+            uint64_t seen = 0;
+            for (size_t bucket = 0; bucket < bucket_count; ++bucket)
+            {
+                seen += m_buckets[bucket];
+                if (seen > target || seen == m_count)
+                {
+                    return std::min(std::chrono::nanoseconds{ static_cast<int64_t>((uint64_t{ 2 } << bucket) - 1) }, max());
+                }
+            }
+
+            return max();
+        }
+
+        const std::array<uint64_t, bucket_count>& buckets() const
+        {
+            return m_buckets;
+        }
+
+    private:
+        std::array<uint64_t, bucket_count> m_buckets{};
+        uint64_t m_count = 0;
+        uint64_t m_total = 0;
+        uint64_t m_max = 0;
+    };
+
+    struct task_latency
+    {
+        // time spent in the scheduler's queue, from scheduled to started
+        latency_histogram wait;
+
+        // time spent running, from started to completed
+        latency_histogram run;
+    };
+
+    //
+    // Default sink, aggregating the queue wait and run time of named tasks
+    // into a latency histogram per task name.
+    //
+    class latency_histogram_sink : public sink
+    {
+    public:
+        void on_started(const task_record& record) override
+        {
+            if (record.name == nullptr || record.scheduled == clock::time_point{})
+                return;
+
+            std::lock_guard<std::mutex> guard{ m_mutex };
+            m_latencies[record.name].wait.record(record.started - record.scheduled);
+        }
+
+        void on_completed(const task_record& record) override
+        {
+            if (record.name == nullptr || record.started == clock::time_point{})
+                return;
+
+            std::lock_guard<std::mutex> guard{ m_mutex };
+            m_latencies[record.name].run.record(record.completed - record.started);
+        }
+
+        std::map<std::string, task_latency> snapshot() const
+        {
+            std::lock_guard<std::mutex> guard{ m_mutex };
+            return { m_latencies.begin(), m_latencies.end() };
+        }
+
+        void reset()
+        {
+            std::lock_guard<std::mutex> guard{ m_mutex };
+            m_latencies.clear();
+        }
+
+    private:
+        mutable std::mutex m_mutex;
+        std::unordered_map<std::string_view, task_latency> m_latencies;
+    };
+
+    namespace detail
+    {
+        //
+        // The part of a task payload that tracks its lifecycle.
+        //
+        class task_tracker
+        {
+        public:
+            task_tracker()
+                : m_record{ next_id.fetch_add(1, std::memory_order_relaxed), current_name, clock::time_point{}, clock::time_point{}, clock::time_point{}, clock::time_point{} }
+            {
+                notify(&task_record::created, &sink::on_created);
+            }
+
+            void scheduled()
+            {
+                notify(&task_record::scheduled, &sink::on_scheduled);
+            }
+
+            void started()
+            {
+                notify(&task_record::started, &sink::on_started);
+            }
+
+            void completed()
+            {
+                notify(&task_record::completed, &sink::on_completed);
+            }
+
+        private:
+            void notify(clock::time_point task_record::*step, void (sink::*hook)(const task_record&))
+            {
+                if (sink* target = get_sink())
+                {
+                    m_record.*step = clock::now();
+                    (target->*hook)(m_record);
+                }
+            }
+
+            task_record m_record;
+        };
+    }
+}
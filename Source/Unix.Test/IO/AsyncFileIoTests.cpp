@@ -0,0 +1,187 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#include <arcana/io/async_file_io.h>
+#include <arcana/threading/task.h>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdlib>
+#include <thread>
+
+namespace
+{
+    constexpr std::array<arcana::async_file_io::backend, 2> backends{
+        arcana::async_file_io::backend::automatic,
+        arcana::async_file_io::backend::thread_pool
+    };
+
+    struct temp_file
+    {
+        temp_file()
+        {
+            char name[] = "/tmp/arcana_async_file_io_XXXXXX";
+            fd = mkstemp(name);
+            path = name;
+            EXPECT_NE(-1, fd);
+        }
+
+        ~temp_file()
+        {
+            close(fd);
+            unlink(path.c_str());
+        }
+
+        std::string path;
+        int fd;
+    };
+
+    std::vector<std::byte> pattern(size_t size)
+    {
+        std::vector<std::byte> data(size);
+        for (size_t i = 0; i < size; ++i)
+        {
+            data[i] = static_cast<std::byte>((i * 7 + i / 251) & 0xFF);
+        }
+        return data;
+    }
+}
+
+TEST(AsyncFileIoTest, WriteAtThenReadAt)
+{
+    for (auto backend : backends)
+    {
+        arcana::async_file_io io{ 64, 2, backend };
+        temp_file file;
+
+        const auto data = pattern(4096);
+        EXPECT_EQ(4096u, io.write_at(file.fd, 0, data).get().value());
+
+        std::vector<std::byte> read(1000);
+        EXPECT_EQ(1000u, io.read_at(file.fd, 100, read).get().value());
+        EXPECT_TRUE(std::equal(read.begin(), read.end(), data.begin() + 100));
+
+        // reading past the end of the file transfers nothing
+        EXPECT_EQ(0u, io.read_at(file.fd, 8192, read).get().value());
+    }
+}
+
+TEST(AsyncFileIoTest, ManyReadsInFlight)
+{
+    for (auto backend : backends)
+    {
+        arcana::async_file_io io{ 64, 4, backend };
+        temp_file file;
+
+        constexpr size_t reads = 512;
+        constexpr size_t readSize = 2048;
+
+        const auto data = pattern(reads * readSize);
+        ASSERT_EQ(static_cast<ssize_t>(data.size()), write(file.fd, data.data(), data.size()));
+
+        std::vector<std::byte> read(data.size());
+        std::vector<arcana::task<size_t, std::error_code>> tasks;
+        {
+            auto batch = io.start_batch();
+            for (size_t i = 0; i < reads; ++i)
+            {
+                tasks.push_back(io.read_at(file.fd, i * readSize, gsl::make_span(read).subspan(i * readSize, readSize)));
+            }
+        }
+
+        auto sizes = arcana::when_all(gsl::make_span(tasks)).get();
+        ASSERT_FALSE(sizes.has_error());
+        EXPECT_EQ(std::vector<size_t>(reads, readSize), sizes.value());
+        EXPECT_EQ(data, read);
+    }
+}
+
+TEST(AsyncFileIoTest, BatchOnlyDefersTheRequestsOfItsThread)
+{
+    arcana::async_file_io io{ 64, 2 };
+    temp_file file;
+
+    const auto data = pattern(4096);
+    ASSERT_EQ(static_cast<ssize_t>(data.size()), write(file.fd, data.data(), data.size()));
+
+    std::vector<std::byte> read(data.size());
+    arcana::task<size_t, std::error_code> batched;
+    {
+        auto batch = io.start_batch();
+        batched = io.read_at(file.fd, 0, gsl::make_span(read).first(2048));
+
+        // a request from another thread goes out while the batch is still open
+        std::vector<std::byte> other(2048);
+        std::thread{ [&] {
+            EXPECT_EQ(2048u, io.read_at(file.fd, 2048, other).get().value());
+        } }.join();
+
+        EXPECT_TRUE(std::equal(other.begin(), other.end(), data.begin() + 2048));
+    }
+
+    EXPECT_EQ(2048u, batched.get().value());
+    EXPECT_TRUE(std::equal(read.begin(), read.begin() + 2048, data.begin()));
+}
+
+TEST(AsyncFileIoTest, WholeFileRoundTrip)
+{
+    for (auto backend : backends)
+    {
+        arcana::async_file_io io{ 64, 2, backend };
+        temp_file file;
+
+        const auto data = pattern(3 * arcana::async_file_io::chunk_size + 12345);
+        EXPECT_EQ(data.size(), io.write_file_async(file.path, data).get().value());
+        EXPECT_EQ(data, io.read_file_async(file.path).get().value());
+    }
+}
+
+TEST(AsyncFileIoTest, MissingFile)
+{
+    arcana::async_file_io io;
+
+    auto result = io.read_file_async("/tmp/arcana_async_file_io_does_not_exist").get();
+    ASSERT_TRUE(result.has_error());
+    EXPECT_EQ(std::errc::no_such_file_or_directory, result.error());
+}
+
+TEST(AsyncFileIoTest, CancelledRequests)
+{
+    for (auto backend : backends)
+    {
+        arcana::async_file_io io{ 64, 2, backend };
+        temp_file file;
+
+        arcana::cancellation_source cancel;
+        cancel.cancel();
+
+        std::vector<std::byte> buffer(16);
+        EXPECT_EQ(std::errc::operation_canceled, io.read_at(file.fd, 0, buffer, cancel).get().error());
+    }
+}
+
+TEST(AsyncFileIoTest, CancelInFlightRead)
+{
+    arcana::async_file_io io;
+    if (!io.uses_io_uring())
+    {
+        GTEST_SKIP() << "only io_uring requests can be cancelled once they started";
+    }
+
+    std::array<int, 2> fds;
+    ASSERT_EQ(0, pipe(fds.data()));
+
+    arcana::cancellation_source cancel;
+    std::vector<std::byte> buffer(16);
+
+    // nothing ever gets written to the pipe
+    auto read = io.read_at(fds[0], 0, buffer, cancel);
+    EXPECT_FALSE(read.wait_for(std::chrono::milliseconds{ 10 }));
+
+    cancel.cancel();
+    EXPECT_EQ(std::errc::operation_canceled, read.get().error());
+
+    close(fds[0]);
+    close(fds[1]);
+}
@@ -0,0 +1,126 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#include <arcana/io/mapped_file.h>
+#include <arcana/threading/dispatcher_pool.h>
+#include <arcana/threading/task.h>
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <mutex>
+#include <numeric>
+
+namespace
+{
+    struct temp_file
+    {
+        explicit temp_file(size_t size)
+        {
+            char name[] = "/tmp/arcana_mapped_file_XXXXXX";
+            const int fd = mkstemp(name);
+            path = name;
+
+            data.resize(size);
+            for (size_t i = 0; i < size; ++i)
+            {
+                data[i] = static_cast<std::byte>(i % 253);
+            }
+
+            EXPECT_EQ(static_cast<ssize_t>(size), write(fd, data.data(), size));
+            close(fd);
+        }
+
+        ~temp_file()
+        {
+            unlink(path.c_str());
+        }
+
+        std::string path;
+        std::vector<std::byte> data;
+    };
+}
+
+TEST(MappedFileTest, MapsTheWholeFile)
+{
+    temp_file file{ 10000 };
+    arcana::mapped_file mapped{ file.path };
+
+    ASSERT_EQ(file.data.size(), mapped.size());
+    EXPECT_TRUE(std::equal(file.data.begin(), file.data.end(), mapped.data().begin()));
+
+    EXPECT_EQ(3u, mapped.chunk_count(4096));
+    EXPECT_EQ(10000u - 2 * 4096u, mapped.chunk(2, 4096).size());
+    EXPECT_EQ(mapped.data().data() + 4096, mapped.chunk(1, 4096).data());
+
+    mapped.prefetch(5000, 100000);
+}
+
+TEST(MappedFileTest, EmptyAndMissingFiles)
+{
+    temp_file file{ 0 };
+    arcana::mapped_file mapped{ file.path };
+    EXPECT_EQ(0u, mapped.size());
+    EXPECT_EQ(0u, mapped.chunk_count(4096));
+
+    EXPECT_THROW(arcana::mapped_file{ "/tmp/arcana_mapped_file_does_not_exist" }, std::system_error);
+}
+
+TEST(MappedFileTest, ForEachChunkVisitsEveryChunkOnce)
+{
+    constexpr size_t chunkSize = 64 * 1024;
+    temp_file file{ 40 * chunkSize + 123 };
+    arcana::mapped_file mapped{ file.path };
+    arcana::dispatcher_pool<32> pool{ 4 };
+
+    std::mutex mutex;
+    std::vector<size_t> visited;
+    std::atomic<size_t> bytes{ 0 };
+    std::atomic<size_t> running{ 0 };
+    std::atomic<size_t> peak{ 0 };
+
+    auto done = mapped.for_each_chunk(pool, arcana::cancellation::none(), chunkSize, 3, [&](gsl::span<const std::byte> chunk, size_t index) noexcept {
+        size_t now = ++running;
+        size_t seen = peak;
+        while (now > seen && !peak.compare_exchange_weak(seen, now)) {}
+
+        EXPECT_EQ(mapped.data().data() + index * chunkSize, chunk.data());
+        bytes += chunk.size();
+        {
+            std::lock_guard<std::mutex> guard{ mutex };
+            visited.push_back(index);
+        }
+
+        --running;
+    });
+
+    EXPECT_FALSE(done.get().has_error());
+    EXPECT_EQ(mapped.size(), bytes.load());
+    EXPECT_LE(peak.load(), 3u);
+
+    std::sort(visited.begin(), visited.end());
+    std::vector<size_t> expected(mapped.chunk_count(chunkSize));
+    std::iota(expected.begin(), expected.end(), size_t{ 0 });
+    EXPECT_EQ(expected, visited);
+}
+
+TEST(MappedFileTest, ForEachChunkStopsOnCancellation)
+{
+    temp_file file{ 1000 };
+    arcana::mapped_file mapped{ file.path };
+    arcana::manual_dispatcher<32> dispatcher;
+    arcana::cancellation_source cancel;
+
+    size_t processed = 0;
+    auto done = mapped.for_each_chunk(dispatcher, cancel, 10, 1, [&](gsl::span<const std::byte>, size_t) noexcept {
+        if (++processed == 5)
+        {
+            cancel.cancel();
+        }
+    });
+
+    while (dispatcher.tick(arcana::cancellation::none())) {}
+
+    EXPECT_EQ(5u, processed);
+    EXPECT_EQ(std::errc::operation_canceled, done.get().error());
+}
@@ -0,0 +1,135 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#include <arcana/threading/epoll_scheduler.h>
+#include <arcana/threading/task.h>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <future>
+
+namespace
+{
+    class epoll_loop
+    {
+    public:
+        epoll_loop()
+            : m_thread{ [this] { scheduler.run(m_cancellation); } }
+        {}
+
+        ~epoll_loop()
+        {
+            m_cancellation.cancel();
+            m_thread.join();
+        }
+
+        arcana::epoll_scheduler<64> scheduler;
+
+    private:
+        arcana::cancellation_source m_cancellation;
+        std::thread m_thread;
+    };
+
+    struct pipe_fds
+    {
+        pipe_fds()
+        {
+            EXPECT_EQ(0, pipe(fds.data()));
+        }
+
+        ~pipe_fds()
+        {
+            close(fds[0]);
+            close(fds[1]);
+        }
+
+        std::array<int, 2> fds{};
+    };
+}
+
+TEST(EpollSchedulerTest, RunsQueuedWorkOnTheLoopThread)
+{
+    epoll_loop loop;
+
+    std::vector<int> order;
+    std::promise<std::thread::id> done;
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        loop.scheduler([&order, i] { order.push_back(i); });
+    }
+
+    loop.scheduler([&] { done.set_value(std::this_thread::get_id()); });
+
+    const auto loopThread = done.get_future().get();
+    EXPECT_NE(std::this_thread::get_id(), loopThread);
+    ASSERT_EQ(1000u, order.size());
+    EXPECT_TRUE(std::is_sorted(order.begin(), order.end()));
+}
+
+TEST(EpollSchedulerTest, WhenReadyCompletesOnceTheFdIsReadable)
+{
+    epoll_loop loop;
+    pipe_fds pipe;
+
+    auto ready = loop.scheduler.when_ready(pipe.fds[0], EPOLLIN);
+    EXPECT_FALSE(ready.wait_for(std::chrono::milliseconds{ 10 }));
+
+    const char byte = 42;
+    ASSERT_EQ(1, write(pipe.fds[1], &byte, 1));
+
+    auto result = ready.then(loop.scheduler, arcana::cancellation::none(), [&](uint32_t events) noexcept {
+        EXPECT_TRUE(loop.scheduler.get_affinity().check());
+        EXPECT_TRUE(events & EPOLLIN);
+
+        char read_byte = 0;
+        EXPECT_EQ(1, read(pipe.fds[0], &read_byte, 1));
+        return read_byte;
+    }).get();
+
+    EXPECT_EQ(42, result.value());
+
+    // the fd can be waited on again once the previous wait completed
+    ASSERT_EQ(1, write(pipe.fds[1], &byte, 1));
+    EXPECT_FALSE(loop.scheduler.when_ready(pipe.fds[0], EPOLLIN).get().has_error());
+}
+
+TEST(EpollSchedulerTest, WhenReadyCanBeCancelled)
+{
+    epoll_loop loop;
+    pipe_fds pipe;
+
+    arcana::cancellation_source cancel;
+    auto ready = loop.scheduler.when_ready(pipe.fds[0], EPOLLIN, cancel);
+
+    EXPECT_EQ(std::make_error_code(std::errc::device_or_resource_busy), loop.scheduler.when_ready(pipe.fds[0], EPOLLIN).get().error());
+
+    cancel.cancel();
+    EXPECT_EQ(std::make_error_code(std::errc::operation_canceled), ready.get().error());
+
+    EXPECT_EQ(std::make_error_code(std::errc::operation_canceled), loop.scheduler.when_ready(pipe.fds[0], EPOLLIN, cancel).get().error());
+}
+
+TEST(EpollSchedulerTest, CancelledWaitCompletesOnTheLoopThread)
+{
+    epoll_loop loop;
+    pipe_fds pipe;
+
+    arcana::cancellation_source cancel;
+    auto ready = loop.scheduler.when_ready(pipe.fds[0], EPOLLIN, cancel);
+
+    std::promise<bool> onLoop;
+    ready.then(arcana::inline_scheduler, arcana::cancellation::none(), [&](const arcana::expected<uint32_t, std::error_code>& result) noexcept {
+        EXPECT_EQ(std::make_error_code(std::errc::operation_canceled), result.error());
+        onLoop.set_value(loop.scheduler.get_affinity().check());
+    });
+
+    cancel.cancel();
+    EXPECT_TRUE(onLoop.get_future().get());
+
+    // the fd is free for someone else to wait on
+    const char byte = 42;
+    ASSERT_EQ(1, write(pipe.fds[1], &byte, 1));
+    EXPECT_FALSE(loop.scheduler.when_ready(pipe.fds[0], EPOLLIN).get().has_error());
+}
@@ -0,0 +1,65 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#include <arcana/threading/dispatcher_pool.h>
+#include <arcana/threading/pin_thread.h>
+#include <arcana/threading/set_thread_name.h>
+#include <arcana/threading/task.h>
+#include <gtest/gtest.h>
+
+#include <string>
+
+namespace
+{
+    std::string current_thread_name()
+    {
+        char name[16]{};
+        pthread_getname_np(pthread_self(), name, sizeof(name));
+        return name;
+    }
+}
+
+TEST(ThreadPlacementTest, SetThreadNameTruncatesLongNames)
+{
+    std::thread{ [] {
+        arcana::set_thread_name("a-rather-long-thread-name");
+        EXPECT_EQ("a-rather-long-t", current_thread_name());
+    } }.join();
+}
+
+TEST(ThreadPlacementTest, PinCurrentThreadRestrictsProcessors)
+{
+    const auto allowed = arcana::current_thread_cpus();
+    ASSERT_FALSE(allowed.empty());
+
+    std::thread{ [&] {
+        EXPECT_FALSE(arcana::pin_current_thread({ allowed.back() }));
+        EXPECT_EQ(std::vector<size_t>{ allowed.back() }, arcana::current_thread_cpus());
+    } }.join();
+}
+
+TEST(ThreadPlacementTest, PinCurrentThreadRejectsInvalidProcessors)
+{
+    EXPECT_EQ(std::make_error_code(std::errc::invalid_argument), arcana::pin_current_thread({ CPU_SETSIZE }));
+}
+
+TEST(ThreadPlacementTest, DispatcherPoolThreadsArePinnedAndNamed)
+{
+    const auto allowed = arcana::current_thread_cpus();
+
+    arcana::dispatcher_pool<32> pool{ 2, [&](size_t index) {
+        arcana::set_thread_name(("worker " + std::to_string(index)).c_str());
+        arcana::pin_current_thread({ allowed[index % allowed.size()] });
+    } };
+
+    for (size_t index = 0; index < pool.size(); ++index)
+    {
+        auto placement = arcana::make_task(pool.at(index), arcana::cancellation::none(), []() noexcept {
+            return std::make_pair(current_thread_name(), arcana::current_thread_cpus());
+        }).get().value();
+
+        EXPECT_EQ("worker " + std::to_string(index), placement.first);
+        EXPECT_EQ(std::vector<size_t>{ allowed[index % allowed.size()] }, placement.second);
+    }
+}
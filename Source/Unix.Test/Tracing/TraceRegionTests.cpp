@@ -0,0 +1,118 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#include <arcana/tracing/trace_region.h>
+#include <gtest/gtest.h>
+
+#include <optional>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+    std::string flush_trace()
+    {
+        std::ostringstream output;
+        arcana::trace_region::flush(output);
+        return output.str();
+    }
+
+    size_t count(const std::string& text, const std::string& pattern)
+    {
+        size_t found = 0;
+        for (size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1))
+        {
+            ++found;
+        }
+        return found;
+    }
+
+    struct trace_session
+    {
+        trace_session()
+        {
+            flush_trace();
+            arcana::trace_region::enable();
+        }
+
+        ~trace_session()
+        {
+            arcana::trace_region::disable();
+            flush_trace();
+        }
+    };
+}
+
+TEST(TraceRegion, DisabledRegionsRecordNothing)
+{
+    flush_trace();
+
+    {
+        arcana::trace_region region{ "disabled" };
+    }
+
+    const std::string trace = flush_trace();
+    EXPECT_EQ(0u, count(trace, "\"ph\""));
+    EXPECT_NE(std::string::npos, trace.find("\"traceEvents\":["));
+}
+
+TEST(TraceRegion, RegionsMovedAcrossThreadsArePairedByCookie)
+{
+    trace_session session;
+
+    std::optional<arcana::trace_region> region{ "moved" };
+    std::thread worker{ [moved = std::move(*region)]() mutable {
+        arcana::trace_region nested{ "nested" };
+        arcana::trace_region end{ std::move(moved) };
+    } };
+    region.reset();
+    worker.join();
+
+    const std::string trace = flush_trace();
+    EXPECT_EQ(2u, count(trace, "\"ph\":\"b\""));
+    EXPECT_EQ(2u, count(trace, "\"ph\":\"e\""));
+    EXPECT_EQ(1u, count(trace, "\"name\":\"moved\""));
+    EXPECT_EQ(1u, count(trace, "\"name\":\"nested\""));
+
+    // the region began on this thread but ended on the worker, under the same id
+    const size_t begin = trace.find("\"name\":\"moved\"");
+    const size_t idStart = trace.rfind("\"id\":", begin);
+    const std::string id = trace.substr(idStart, trace.find(',', idStart) - idStart);
+    EXPECT_EQ(2u, count(trace, id + ","));
+
+    // events are drained by the flush
+    EXPECT_EQ(0u, count(flush_trace(), "\"ph\""));
+}
+
+TEST(TraceRegion, NamesAreEscaped)
+{
+    trace_session session;
+
+    {
+        arcana::trace_region region{ "quote\" slash\\ tab\t" };
+    }
+
+    EXPECT_NE(std::string::npos, flush_trace().find("\"name\":\"quote\\\" slash\\\\ tab\\u0009\""));
+}
+
+TEST(TraceRegion, FullBufferDropsEvents)
+{
+    trace_session session;
+
+    constexpr size_t extra = 10;
+    for (size_t i = 0; i < arcana::detail::trace_event_ring::capacity / 2 + extra; ++i)
+    {
+        arcana::trace_region region{ "region" };
+    }
+
+    const std::string trace = flush_trace();
+    EXPECT_EQ(arcana::detail::trace_event_ring::capacity, count(trace, "\"ph\""));
+    EXPECT_NE(std::string::npos, trace.find("\"dropped_events\":\"" + std::to_string(extra * 2) + "\""));
+
+    // the buffer has room again once flushed
+    {
+        arcana::trace_region region{ "region" };
+    }
+    EXPECT_EQ(2u, count(flush_trace(), "\"ph\""));
+}
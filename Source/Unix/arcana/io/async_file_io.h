@@ -0,0 +1,737 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#pragma once
+
+#include <arcana/threading/cancellation.h>
+#include <arcana/threading/dispatcher_pool.h>
+#include <arcana/threading/task.h>
+
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define ARCANA_HAS_IO_URING
+#endif
+
+namespace arcana
+{
+#ifdef ARCANA_HAS_IO_URING
+    namespace internal
+    {
+        //
+        // Minimal io_uring submission and completion rings, driven through the raw syscalls.
+        // Submission is not thread safe, callers serialize it.
+        //
+        class io_uring_ring
+        {
+        public:
+            explicit io_uring_ring(unsigned entries)
+            {
+                io_uring_params params{};
+                m_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+                if (m_fd < 0)
+                {
+                    throw std::system_error{ errno, std::system_category() };
+                }
+
+                bool mapped = false;
+                auto cleanup = gsl::finally([this, &mapped] {
+                    if (!mapped)
+                        destroy();
+                });
+
+                // IORING_OP_READ and IORING_OP_WRITE showed up in the same kernel version as this feature
+                if ((params.features & IORING_FEAT_RW_CUR_POS) == 0)
+                {
+                    throw std::system_error{ std::make_error_code(std::errc::function_not_supported) };
+                }
+
+                m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+                m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+                const bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+                if (singleMmap)
+                {
+                    m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+                }
+
+                m_sqRing = map(m_sqRingSize, IORING_OFF_SQ_RING);
+                m_cqRing = singleMmap ? m_sqRing : map(m_cqRingSize, IORING_OFF_CQ_RING);
+                m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+                m_sqes = static_cast<io_uring_sqe*>(map(m_sqesSize, IORING_OFF_SQES));
+
+                auto* sq = static_cast<char*>(m_sqRing);
+                m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+                m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+                m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+                m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+                m_sqEntries = params.sq_entries;
+
+                auto* cq = static_cast<char*>(m_cqRing);
+                m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+                m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+                m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+                m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+                mapped = true;
+            }
+
+            io_uring_ring(const io_uring_ring&) = delete;
+            io_uring_ring& operator=(const io_uring_ring&) = delete;
+
+            ~io_uring_ring()
+            {
+                destroy();
+            }
+
+            unsigned sq_entries() const
+            {
+                return m_sqEntries;
+            }
+
+            //
+            // Returns a zeroed submission entry, or nullptr if the submission ring is full.
+            // The entry gets handed to the kernel with the next call to submit.
+            //
+            io_uring_sqe* get_sqe()
+            {
+                const unsigned tail = *m_sqTail;
+                if (tail - std::atomic_ref<unsigned>{ *m_sqHead }.load(std::memory_order_acquire) >= m_sqEntries)
+                    return nullptr;
+
+                const unsigned index = tail & m_sqMask;
+                io_uring_sqe* sqe = &m_sqes[index];
+                *sqe = {};
+                m_sqArray[index] = index;
+
+                std::atomic_ref<unsigned>{ *m_sqTail }.store(tail + 1, std::memory_order_release);
+                return sqe;
+            }
+
+            int submit()
+            {
+                const unsigned pending = *m_sqTail - std::atomic_ref<unsigned>{ *m_sqHead }.load(std::memory_order_acquire);
+                if (pending == 0)
+                    return 0;
+
+                return enter(pending, 0, 0);
+            }
+
+            //
+            // Blocks until at least one completion is available.
+            //
+            int wait()
+            {
+                return enter(0, 1, IORING_ENTER_GETEVENTS);
+            }
+
+            template<typename CallableT>
+            void for_each_cqe(CallableT&& callable)
+            {
+                unsigned head = *m_cqHead;
+                const unsigned tail = std::atomic_ref<unsigned>{ *m_cqTail }.load(std::memory_order_acquire);
+
+                for (; head != tail; ++head)
+                {
+                    callable(m_cqes[head & m_cqMask]);
+                }
+
+                std::atomic_ref<unsigned>{ *m_cqHead }.store(head, std::memory_order_release);
+            }
+
+        private:
+            void* map(size_t size, off_t offset)
+            {
+                void* result = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, offset);
+                if (result == MAP_FAILED)
+                {
+                    throw std::system_error{ errno, std::system_category() };
+                }
+
+                return result;
+            }
+
+            int enter(unsigned toSubmit, unsigned minComplete, unsigned flags)
+            {
+                const int result = static_cast<int>(syscall(__NR_io_uring_enter, m_fd, toSubmit, minComplete, flags, nullptr, 0));
+                return result < 0 ? -errno : result;
+            }
+
+            void destroy()
+            {
+                if (m_sqes != nullptr)
+                {
+                    munmap(m_sqes, m_sqesSize);
+                }
+
+                if (m_cqRing != nullptr && m_cqRing != m_sqRing)
+                {
+                    munmap(m_cqRing, m_cqRingSize);
+                }
+
+                if (m_sqRing != nullptr)
+                {
+                    munmap(m_sqRing, m_sqRingSize);
+                }
+
+                close(m_fd);
+                m_fd = -1;
+            }
+
+            int m_fd = -1;
+
+            void* m_sqRing = nullptr;
+            size_t m_sqRingSize = 0;
+            void* m_cqRing = nullptr;
+            size_t m_cqRingSize = 0;
+            io_uring_sqe* m_sqes = nullptr;
+            size_t m_sqesSize = 0;
+
+            unsigned* m_sqHead = nullptr;
+            unsigned* m_sqTail = nullptr;
+            unsigned m_sqMask = 0;
+            unsigned* m_sqArray = nullptr;
+            unsigned m_sqEntries = 0;
+
+            unsigned* m_cqHead = nullptr;
+            unsigned* m_cqTail = nullptr;
+            unsigned m_cqMask = 0;
+            io_uring_cqe* m_cqes = nullptr;
+        };
+    }
+#endif
+
+    //
+    // Asynchronous positional file reads and writes that return tasks.
+    //
+    // On Linux kernels with io_uring, requests are queued on a ring whose completions
+    // are reaped by a single thread, so hundreds of reads can be in flight without
+    // tying up a thread each. Requests issued within a batch scope are handed to the
+    // kernel with a single syscall when the scope ends. Everywhere else requests run
+    // as blocking pread/pwrite calls on a fixed size pool of threads.
+    //
+    // Like pread and pwrite, a request can transfer fewer bytes than asked for. Buffers
+    // have to stay alive until the returned task completes. Cancelling the token of a
+    // request completes it with std::errc::operation_canceled unless it already finished.
+    //
+    class async_file_io
+    {
+    public:
+        enum class backend
+        {
+            automatic,
+            thread_pool
+        };
+
+        explicit async_file_io(unsigned queueDepth = 256, size_t threadCount = 4, backend requested = backend::automatic)
+        {
+#ifdef ARCANA_HAS_IO_URING
+            if (requested == backend::automatic)
+            {
+                try
+                {
+                    m_ring.emplace(queueDepth);
+                    m_reaper = std::thread{ [this] { reap(); } };
+                    return;
+                }
+                catch (const std::system_error&)
+                {
+                    // io_uring isn't available, either the kernel is too old or it's been disabled
+                    m_ring.reset();
+                }
+            }
+#else
+            (void)queueDepth;
+            (void)requested;
+#endif
+            m_pool.emplace(std::max<size_t>(threadCount, 1));
+        }
+
+        async_file_io(const async_file_io&) = delete;
+        async_file_io& operator=(const async_file_io&) = delete;
+
+        ~async_file_io()
+        {
+#ifdef ARCANA_HAS_IO_URING
+            if (m_ring)
+            {
+                std::vector<operation> dropped;
+                {
+                    std::lock_guard<std::mutex> guard{ m_mutex };
+
+                    m_stopping = true;
+
+                    for (uint64_t id : m_backlog)
+                    {
+                        dropped.emplace_back(take(id));
+                    }
+                    m_backlog.clear();
+
+                    for (auto& [id, op] : m_operations)
+                    {
+                        prepare_cancel(id);
+                    }
+
+                    prepare_wake();
+                    m_ring->submit();
+                }
+
+                for (auto& op : dropped)
+                {
+                    op.source.complete(make_unexpected(std::make_error_code(std::errc::operation_canceled)));
+                }
+
+                m_reaper.join();
+            }
+#endif
+        }
+
+        bool uses_io_uring() const
+        {
+#ifdef ARCANA_HAS_IO_URING
+            return m_ring.has_value();
+#else
+            return false;
+#endif
+        }
+
+        //
+        // Defers handing the requests the calling thread issues over to the kernel until
+        // the returned scope ends, requests from other threads still go out right away
+        // (and take the ones batched so far along with them). Scopes have to end on the
+        // thread that started them. This doesn't do anything for the thread pool backend.
+        //
+        class batch
+        {
+        public:
+            batch(const batch&) = delete;
+            batch& operator=(const batch&) = delete;
+
+            ~batch()
+            {
+                innermost() = m_outer;
+                m_io.end_batch();
+            }
+
+        private:
+            friend class async_file_io;
+
+            explicit batch(async_file_io& io)
+                : m_io{ io }
+                , m_outer{ std::exchange(innermost(), this) }
+            {}
+
+            // the batch scopes of a thread form a stack, for any number of async_file_io instances
+            static batch*& innermost()
+            {
+                thread_local batch* scope = nullptr;
+                return scope;
+            }
+
+            async_file_io& m_io;
+            batch* m_outer;
+        };
+
+        batch start_batch()
+        {
+            return batch{ *this };
+        }
+
+        task<size_t, std::error_code> read_at(int fd, uint64_t offset, gsl::span<std::byte> buffer, cancellation& token = cancellation::none())
+        {
+            return request(opcode::read, fd, offset, buffer.data(), buffer.size(), token);
+        }
+
+        task<size_t, std::error_code> write_at(int fd, uint64_t offset, gsl::span<const std::byte> buffer, cancellation& token = cancellation::none())
+        {
+            return request(opcode::write, fd, offset, const_cast<std::byte*>(buffer.data()), buffer.size(), token);
+        }
+
+        //
+        // Reads a whole file, in chunks that are all in flight at the same time.
+        //
+        task<std::vector<std::byte>, std::error_code> read_file_async(const std::string& path, cancellation& token = cancellation::none())
+        {
+            auto file = open_file(path.c_str(), O_RDONLY);
+            if (!file)
+                return task_from_error<std::vector<std::byte>>(file.error());
+
+            struct stat info;
+            if (fstat(file.value()->fd, &info) == -1)
+                return task_from_error<std::vector<std::byte>>(std::error_code{ errno, std::system_category() });
+
+            auto data = std::make_shared<std::vector<std::byte>>(static_cast<size_t>(info.st_size));
+
+            return transfer_chunks(opcode::read, file.value(), data->data(), data->size(), token)
+                .then(inline_scheduler, cancellation::none(), [data, file = file.value()](size_t transferred) noexcept {
+                    // the file might have shrunk in the meantime
+                    data->resize(transferred);
+                    return std::move(*data);
+                });
+        }
+
+        //
+        // Replaces the content of a file, in chunks that are all in flight at the same time.
+        // The data has to stay alive until the returned task completes.
+        //
+        task<size_t, std::error_code> write_file_async(const std::string& path, gsl::span<const std::byte> data, cancellation& token = cancellation::none())
+        {
+            auto file = open_file(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC);
+            if (!file)
+                return task_from_error<size_t>(file.error());
+
+            return transfer_chunks(opcode::write, file.value(), const_cast<std::byte*>(data.data()), data.size(), token)
+                .then(inline_scheduler, cancellation::none(), [file = file.value()](size_t transferred) noexcept {
+                    return transferred;
+                });
+        }
+
+        static constexpr size_t chunk_size = 1 << 20;
+
+    private:
+        enum class opcode
+        {
+            read,
+            write
+        };
+
+        struct file_handle
+        {
+            explicit file_handle(int fd)
+                : fd{ fd }
+            {}
+
+            ~file_handle()
+            {
+                close(fd);
+            }
+
+            int fd;
+        };
+
+        struct operation
+        {
+            task_completion_source<size_t, std::error_code> source;
+            opcode op;
+            int fd;
+            uint64_t offset;
+            std::byte* buffer;
+            size_t size;
+            std::optional<cancellation::ticket> ticket{};
+        };
+
+        static expected<std::shared_ptr<file_handle>, std::error_code> open_file(const char* path, int flags)
+        {
+            const int fd = open(path, flags | O_CLOEXEC, 0644);
+            if (fd == -1)
+                return make_unexpected(std::error_code{ errno, std::system_category() });
+
+            return std::make_shared<file_handle>(fd);
+        }
+
+        task<size_t, std::error_code> transfer_chunks(opcode op, std::shared_ptr<file_handle> file, std::byte* data, size_t size, cancellation& token)
+        {
+            std::vector<task<size_t, std::error_code>> chunks;
+            chunks.reserve(size / chunk_size + 1);
+
+            auto batch = start_batch();
+            for (size_t offset = 0; offset < size; offset += chunk_size)
+            {
+                chunks.emplace_back(transfer_fully(op, file->fd, offset, data + offset, std::min(chunk_size, size - offset), token));
+            }
+
+            return when_all(gsl::make_span(chunks)).then(inline_scheduler, cancellation::none(), [](const std::vector<size_t>& transferred) noexcept {
+                size_t total = 0;
+                for (size_t chunk : transferred)
+                {
+                    total += chunk;
+                }
+                return total;
+            });
+        }
+
+        // retries short transfers until the whole range is done, or the end of the file is reached
+        task<size_t, std::error_code> transfer_fully(opcode op, int fd, uint64_t offset, std::byte* buffer, size_t size, cancellation& token)
+        {
+            return request(op, fd, offset, buffer, size, token)
+                .then(inline_scheduler, cancellation::none(), [this, op, fd, offset, buffer, size, &token](size_t transferred) noexcept {
+                    if (transferred == 0 || transferred == size)
+                        return task_from_result<std::error_code>(size_t{ transferred });
+
+                    return transfer_fully(op, fd, offset + transferred, buffer + transferred, size - transferred, token)
+                        .then(inline_scheduler, cancellation::none(), [transferred](size_t rest) noexcept {
+                            return transferred + rest;
+                        });
+                });
+        }
+
+        task<size_t, std::error_code> request(opcode op, int fd, uint64_t offset, std::byte* buffer, size_t size, cancellation& token)
+        {
+            if (token.cancelled())
+                return task_from_error<size_t>(std::make_error_code(std::errc::operation_canceled));
+
+#ifdef ARCANA_HAS_IO_URING
+            if (m_ring)
+                return ring_request(operation{ {}, op, fd, offset, buffer, std::min<size_t>(size, UINT_MAX) }, token);
+#endif
+
+            return make_task(*m_pool, token, [op, fd, offset, buffer, size]() noexcept -> expected<size_t, std::error_code> {
+                const ssize_t result = op == opcode::read
+                    ? pread(fd, buffer, size, static_cast<off_t>(offset))
+                    : pwrite(fd, buffer, size, static_cast<off_t>(offset));
+
+                if (result == -1)
+                    return make_unexpected(std::error_code{ errno, std::system_category() });
+
+                return static_cast<size_t>(result);
+            });
+        }
+
+        // whether the calling thread is within a batch scope of this instance
+        bool batching() const
+        {
+            for (const batch* scope = batch::innermost(); scope != nullptr; scope = scope->m_outer)
+            {
+                if (&scope->m_io == this)
+                    return true;
+            }
+
+            return false;
+        }
+
+        void end_batch()
+        {
+#ifdef ARCANA_HAS_IO_URING
+            if (m_ring && !batching())
+            {
+                std::lock_guard<std::mutex> guard{ m_mutex };
+                m_ring->submit();
+            }
+#endif
+        }
+
+#ifdef ARCANA_HAS_IO_URING
+        // user_data values that don't belong to a request
+        static constexpr uint64_t wake_tag = 0;
+        static constexpr uint64_t cancel_tag = ~uint64_t{ 0 };
+
+        task<size_t, std::error_code> ring_request(operation&& op, cancellation& token)
+        {
+            task<size_t, std::error_code> result = op.source.as_task();
+            const bool batched = batching();
+
+            uint64_t id;
+            {
+                std::lock_guard<std::mutex> guard{ m_mutex };
+
+                id = m_nextId++;
+                auto& queued = m_operations.emplace(id, std::move(op)).first->second;
+
+                // Keep enough room in the completion ring for cancellations, anything
+                // beyond that waits in the backlog until requests complete.
+                if (m_inFlight < m_ring->sq_entries() && prepare(id, queued))
+                {
+                    m_inFlight++;
+
+                    if (!batched)
+                    {
+                        m_ring->submit();
+                    }
+                }
+                else
+                {
+                    m_backlog.push_back(id);
+                }
+            }
+
+            // The listener can run right away if the token got cancelled in the meantime,
+            // so only hold on to its ticket if the request is still around afterwards.
+            cancellation::ticket ticket = token.add_listener([this, id] { cancel(id); });
+            {
+                std::lock_guard<std::mutex> guard{ m_mutex };
+
+                auto found = m_operations.find(id);
+                if (found != m_operations.end())
+                {
+                    found->second.ticket.emplace(std::move(ticket));
+                }
+            }
+
+            return result;
+        }
+
+        bool prepare(uint64_t id, const operation& op)
+        {
+            io_uring_sqe* sqe = m_ring->get_sqe();
+            if (sqe == nullptr)
+                return false;
+
+            sqe->opcode = op.op == opcode::read ? IORING_OP_READ : IORING_OP_WRITE;
+            sqe->fd = op.fd;
+            sqe->off = op.offset;
+            sqe->addr = reinterpret_cast<uint64_t>(op.buffer);
+            sqe->len = static_cast<unsigned>(op.size);
+            sqe->user_data = id;
+            return true;
+        }
+
+        io_uring_sqe* get_sqe_or_submit()
+        {
+            io_uring_sqe* sqe;
+            while ((sqe = m_ring->get_sqe()) == nullptr)
+            {
+                m_ring->submit();
+            }
+
+            return sqe;
+        }
+
+        void prepare_cancel(uint64_t id)
+        {
+            io_uring_sqe* sqe = get_sqe_or_submit();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = id;
+            sqe->user_data = cancel_tag;
+        }
+
+        void prepare_wake()
+        {
+            io_uring_sqe* sqe = get_sqe_or_submit();
+            sqe->opcode = IORING_OP_NOP;
+            sqe->fd = -1;
+            sqe->user_data = wake_tag;
+        }
+
+        operation take(uint64_t id)
+        {
+            auto found = m_operations.find(id);
+            operation op{ std::move(found->second) };
+            m_operations.erase(found);
+            return op;
+        }
+
+        void cancel(uint64_t id)
+        {
+            std::optional<operation> dropped;
+            {
+                std::lock_guard<std::mutex> guard{ m_mutex };
+
+                if (m_operations.find(id) == m_operations.end())
+                    return;
+
+                auto backlogged = std::find(m_backlog.begin(), m_backlog.end(), id);
+                if (backlogged != m_backlog.end())
+                {
+                    m_backlog.erase(backlogged);
+                    dropped.emplace(take(id));
+                }
+                else
+                {
+                    // the request completes with -ECANCELED if the kernel gets to it in time
+                    prepare_cancel(id);
+                    m_ring->submit();
+                }
+            }
+
+            if (dropped)
+            {
+                dropped->source.complete(make_unexpected(std::make_error_code(std::errc::operation_canceled)));
+            }
+        }
+
+        void reap()
+        {
+            std::vector<std::pair<operation, int>> completed;
+
+            while (true)
+            {
+                const int waited = m_ring->wait();
+                if (waited < 0 && waited != -EINTR && waited != -EAGAIN && waited != -EBUSY)
+                {
+                    // the ring is unusable, and requests in flight still reference their buffers
+                    std::terminate();
+                }
+
+                bool stop = false;
+                {
+                    std::lock_guard<std::mutex> guard{ m_mutex };
+
+                    m_ring->for_each_cqe([&](const io_uring_cqe& cqe) {
+                        if (cqe.user_data == wake_tag || cqe.user_data == cancel_tag)
+                            return;
+
+                        completed.emplace_back(take(cqe.user_data), cqe.res);
+                        m_inFlight--;
+                    });
+
+                    while (!m_backlog.empty() && m_inFlight < m_ring->sq_entries() && prepare(m_backlog.front(), m_operations.at(m_backlog.front())))
+                    {
+                        m_backlog.pop_front();
+                        m_inFlight++;
+                    }
+
+                    m_ring->submit();
+
+                    stop = m_stopping && m_inFlight == 0 && m_backlog.empty();
+                }
+
+                for (auto& [op, res] : completed)
+                {
+                    if (res >= 0)
+                    {
+                        op.source.complete(static_cast<size_t>(res));
+                    }
+                    else
+                    {
+                        op.source.complete(make_unexpected(res == -ECANCELED
+                            ? std::make_error_code(std::errc::operation_canceled)
+                            : std::error_code{ -res, std::system_category() }));
+                    }
+                }
+
+                completed.clear();
+
+                if (stop)
+                    break;
+            }
+        }
+
+        std::optional<internal::io_uring_ring> m_ring;
+        std::thread m_reaper;
+
+        std::mutex m_mutex;
+        std::unordered_map<uint64_t, operation> m_operations;
+        std::deque<uint64_t> m_backlog;
+        uint64_t m_nextId = 1;
+        unsigned m_inFlight = 0;
+        bool m_stopping = false;
+#endif
+
+        std::optional<dispatcher_pool<64>> m_pool;
+    };
+}
@@ -0,0 +1,213 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#pragma once
+
+#include <arcana/threading/cancellation.h>
+#include <arcana/threading/task.h>
+
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace arcana
+{
+    //
+    // Read-only memory mapping of a whole file, so that parsing stages can work
+    // directly on the file's pages instead of copies of them. Chunks handed out
+    // are only valid as long as the mapped_file is alive.
+    //
+    class mapped_file
+    {
+    public:
+        explicit mapped_file(const std::string& path)
+        {
+            const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1)
+            {
+                throw std::system_error{ errno, std::system_category() };
+            }
+
+            auto closeFile = gsl::finally([fd] { close(fd); });
+
+            struct stat info;
+            if (fstat(fd, &info) == -1)
+            {
+                throw std::system_error{ errno, std::system_category() };
+            }
+
+            m_size = static_cast<size_t>(info.st_size);
+            if (m_size == 0)
+                return;
+
+            void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED)
+            {
+                throw std::system_error{ errno, std::system_category() };
+            }
+
+            m_data = static_cast<const std::byte*>(data);
+
+            // the kernel reads ahead more aggressively for sequential access
+            madvise(const_cast<std::byte*>(m_data), m_size, MADV_SEQUENTIAL);
+        }
+
+        mapped_file(mapped_file&& other) noexcept
+            : m_data{ std::exchange(other.m_data, nullptr) }
+            , m_size{ std::exchange(other.m_size, 0) }
+        {}
+
+        mapped_file& operator=(mapped_file&& other) noexcept
+        {
+            if (this != &other)
+            {
+                unmap();
+                m_data = std::exchange(other.m_data, nullptr);
+                m_size = std::exchange(other.m_size, 0);
+            }
+
+            return *this;
+        }
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+
+        ~mapped_file()
+        {
+            unmap();
+        }
+
+        gsl::span<const std::byte> data() const
+        {
+            return { m_data, m_size };
+        }
+
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        size_t chunk_count(size_t chunkSize) const
+        {
+            GSL_CONTRACT_CHECK("chunk size", chunkSize > 0);
+            return (m_size + chunkSize - 1) / chunkSize;
+        }
+
+        gsl::span<const std::byte> chunk(size_t index, size_t chunkSize) const
+        {
+            GSL_CONTRACT_CHECK("chunk size", chunkSize > 0);
+
+            const size_t offset = index * chunkSize;
+            GSL_CONTRACT_CHECK("chunk index", offset < m_size);
+
+            return data().subspan(offset, std::min(chunkSize, m_size - offset));
+        }
+
+        //
+        // Asks the kernel to start reading the given range in the background.
+        //
+        void prefetch(size_t offset, size_t length) const
+        {
+            if (offset >= m_size)
+                return;
+
+            // madvise wants a page aligned address
+            static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            const size_t aligned = offset - offset % pageSize;
+            length = std::min(length + (offset - aligned), m_size - aligned);
+
+            madvise(const_cast<std::byte*>(m_data) + aligned, length, MADV_WILLNEED);
+        }
+
+        //
+        // Invokes callback(chunk, index) on the scheduler for every chunk of the file, with at most
+        // maxInFlight chunks queued or running at once. Chunks are prefetched maxInFlight chunks ahead
+        // of the ones being processed. The returned task completes once every chunk got processed,
+        // and the callback must be noexcept.
+        //
+        template<typename SchedulerT, typename CallableT>
+        task<void, std::error_code> for_each_chunk(SchedulerT& scheduler, cancellation& token, size_t chunkSize, size_t maxInFlight, CallableT&& callback) const
+        {
+            GSL_CONTRACT_CHECK("chunk size", chunkSize > 0);
+            GSL_CONTRACT_CHECK("chunks in flight", maxInFlight > 0);
+
+            using state_t = chunk_stream<std::decay_t<CallableT>>;
+            auto state = std::make_shared<state_t>(*this, chunkSize, maxInFlight, std::forward<CallableT>(callback));
+
+            prefetch(0, maxInFlight * chunkSize);
+
+            // each lane processes one chunk at a time, pulling the next one when it's done
+            std::vector<task<void, std::error_code>> lanes;
+            for (size_t lane = 0; lane < std::min(maxInFlight, state->count); ++lane)
+            {
+                lanes.emplace_back(next_chunk(scheduler, token, state));
+            }
+
+            return when_all(gsl::make_span(lanes));
+        }
+
+    private:
+        template<typename CallableT>
+        struct chunk_stream
+        {
+            template<typename C>
+            chunk_stream(const mapped_file& file, size_t chunkSize, size_t maxInFlight, C&& callback)
+                : file{ file }
+                , chunkSize{ chunkSize }
+                , maxInFlight{ maxInFlight }
+                , count{ file.chunk_count(chunkSize) }
+                , callback{ std::forward<C>(callback) }
+            {}
+
+            const mapped_file& file;
+            size_t chunkSize;
+            size_t maxInFlight;
+            size_t count;
+            CallableT callback;
+            std::atomic<size_t> next{ 0 };
+        };
+
+        template<typename SchedulerT, typename StateT>
+        static task<void, std::error_code> next_chunk(SchedulerT& scheduler, cancellation& token, const std::shared_ptr<StateT>& state)
+        {
+            const size_t index = state->next++;
+            if (index >= state->count)
+                return task_from_result<std::error_code>();
+
+            // by the time a chunk gets processed, the window ahead of it has to be on its way
+            state->file.prefetch((index + state->maxInFlight) * state->chunkSize, state->chunkSize);
+
+            return make_task(scheduler, token, [state, index]() noexcept {
+                state->callback(state->file.chunk(index, state->chunkSize), index);
+            }).then(inline_scheduler, cancellation::none(), [&scheduler, &token, state]() noexcept {
+                return next_chunk(scheduler, token, state);
+            });
+        }
+
+        void unmap()
+        {
+            if (m_data != nullptr)
+            {
+                munmap(const_cast<std::byte*>(m_data), m_size);
+                m_data = nullptr;
+            }
+        }
+
+        const std::byte* m_data = nullptr;
+        size_t m_size = 0;
+    };
+}
@@ -0,0 +1,330 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#pragma once
+
+#include <arcana/functional/inplace_function.h>
+#include <arcana/threading/affinity.h>
+#include <arcana/threading/cancellation.h>
+#include <arcana/threading/task.h>
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <mutex>
+#include <optional>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace arcana
+{
+    //
+    // Scheduler backed by an epoll loop, for threads that need to both run task
+    // continuations and wait on file descriptors like sockets or pipes.
+    //
+    // Queued work is kept in memory and the loop thread is woken through a single
+    // eventfd, which is only written to once per batch of work queued while the loop
+    // is busy or asleep. Call run on the thread that should own the loop.
+    //
+    template<size_t WorkSize>
+    class epoll_scheduler
+    {
+    public:
+        using callback_t = stdext::inplace_function<void(), WorkSize>;
+        static constexpr size_t work_size = WorkSize;
+
+        epoll_scheduler()
+            : m_epoll{ epoll_create1(EPOLL_CLOEXEC) }
+            , m_wakeup{ eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) }
+        {
+            if (m_epoll == -1 || m_wakeup == -1)
+            {
+                const int error = errno;
+                close_fds();
+                throw std::system_error{ error, std::system_category() };
+            }
+
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = m_wakeup;
+            if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeup, &event) == -1)
+            {
+                const int error = errno;
+                close_fds();
+                throw std::system_error{ error, std::system_category() };
+            }
+        }
+
+        epoll_scheduler(const epoll_scheduler&) = delete;
+        epoll_scheduler& operator=(const epoll_scheduler&) = delete;
+
+        ~epoll_scheduler()
+        {
+            std::unordered_map<int, waiter> waiters;
+            std::vector<waiter> canceled;
+            {
+                std::lock_guard<std::mutex> guard{ m_mutex };
+                std::swap(waiters, m_waiters);
+                std::swap(canceled, m_canceled);
+            }
+
+            for (auto& [fd, waiter] : waiters)
+            {
+                waiter.source.complete(make_unexpected(std::make_error_code(std::errc::operation_canceled)));
+            }
+
+            for (auto& waiter : canceled)
+            {
+                waiter.source.complete(make_unexpected(std::make_error_code(std::errc::operation_canceled)));
+            }
+
+            close_fds();
+        }
+
+        template<typename CallableT>
+        void queue(CallableT&& callable)
+        {
+            {
+                std::lock_guard<std::mutex> guard{ m_mutex };
+                m_queue.emplace_back(std::forward<CallableT>(callable));
+            }
+
+            wake();
+        }
+
+        template<typename CallableT>
+        void operator()(CallableT&& callable)
+        {
+            queue(std::forward<CallableT>(callable));
+        }
+
+        affinity get_affinity() const
+        {
+            return m_affinity;
+        }
+
+        //
+        // Returns a task that completes on the loop thread with the epoll events that
+        // fired once fd is ready for any of the requested events (e.g. EPOLLIN). Only
+        // one task can wait on a given fd at a time.
+        //
+        // Cancelling the token stops the wait right away, but the task completes with
+        // operation_canceled on the loop thread as well, so it doesn't complete before
+        // the loop runs again (or the scheduler gets destroyed).
+        //
+        task<uint32_t, std::error_code> when_ready(int fd, uint32_t events, cancellation& token = cancellation::none())
+        {
+            if (token.cancelled())
+            {
+                return task_from_error<uint32_t>(std::make_error_code(std::errc::operation_canceled));
+            }
+
+            task_completion_source<uint32_t, std::error_code> source;
+            uint64_t id;
+            {
+                std::lock_guard<std::mutex> guard{ m_mutex };
+
+                id = m_nextWaiter++;
+                if (!m_waiters.emplace(fd, waiter{ source, id }).second)
+                {
+                    return task_from_error<uint32_t>(std::make_error_code(std::errc::device_or_resource_busy));
+                }
+
+                epoll_event event{};
+                event.events = events | EPOLLONESHOT;
+                event.data.fd = fd;
+                if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) == -1)
+                {
+                    m_waiters.erase(fd);
+                    return task_from_error<uint32_t>(std::error_code{ errno, std::system_category() });
+                }
+            }
+
+            // The listener can run right away if the token got cancelled in the meantime,
+            // so only hold on to its ticket if the waiter is still around afterwards.
+            // It can also run late, once the fd is waited on by someone else, so it
+            // only cancels the waiter it was added for.
+            cancellation::ticket ticket = token.add_listener([this, fd, id] {
+                cancel_waiter(fd, id);
+            });
+
+            {
+                std::lock_guard<std::mutex> guard{ m_mutex };
+
+                auto found = m_waiters.find(fd);
+                if (found != m_waiters.end() && found->second.id == id)
+                {
+                    found->second.ticket.emplace(std::move(ticket));
+                }
+            }
+
+            return source.as_task();
+        }
+
+        //
+        // Runs the loop on the calling thread until the token gets cancelled.
+        //
+        void run(cancellation& token)
+        {
+            m_affinity = std::this_thread::get_id();
+
+            auto registration = token.add_listener([this] { wake(); });
+
+            std::array<epoll_event, 64> events;
+
+            while (!token.cancelled())
+            {
+                run_queued();
+
+                if (token.cancelled())
+                    break;
+
+                const int count = epoll_wait(m_epoll, events.data(), static_cast<int>(events.size()), -1);
+                if (count == -1)
+                {
+                    if (errno == EINTR)
+                        continue;
+
+                    throw std::system_error{ errno, std::system_category() };
+                }
+
+                for (int index = 0; index < count; ++index)
+                {
+                    const epoll_event& event = events[index];
+                    if (event.data.fd == m_wakeup)
+                    {
+                        // Reset the signal before draining the queue, so that work
+                        // queued while we're draining it wakes us up again.
+                        uint64_t value;
+                        [[maybe_unused]] auto result = read(m_wakeup, &value, sizeof(value));
+                        m_signaled = false;
+                    }
+                    else
+                    {
+                        ready(event.data.fd, event.events);
+                    }
+                }
+            }
+        }
+
+    private:
+        struct waiter
+        {
+            task_completion_source<uint32_t, std::error_code> source;
+            uint64_t id;
+            std::optional<cancellation::ticket> ticket{};
+        };
+
+        void wake()
+        {
+            if (!m_signaled.exchange(true))
+            {
+                const uint64_t value = 1;
+                [[maybe_unused]] auto result = write(m_wakeup, &value, sizeof(value));
+            }
+        }
+
+        void run_queued()
+        {
+            std::vector<waiter> canceled;
+            {
+                std::lock_guard<std::mutex> guard{ m_mutex };
+                std::swap(m_queue, m_workload);
+                std::swap(m_canceled, canceled);
+            }
+
+            for (auto& waiter : canceled)
+            {
+                waiter.source.complete(make_unexpected(std::make_error_code(std::errc::operation_canceled)));
+            }
+
+            for (auto& work : m_workload)
+            {
+                work();
+            }
+
+            m_workload.clear();
+        }
+
+        void ready(int fd, uint32_t events)
+        {
+            std::unique_lock<std::mutex> guard{ m_mutex };
+            std::optional<waiter> found = take_waiter(fd, std::nullopt);
+            guard.unlock();
+
+            // the waiter, and its cancellation ticket, get destroyed outside of the lock
+            if (found)
+            {
+                found->source.complete(events);
+            }
+        }
+
+        void cancel_waiter(int fd, uint64_t id)
+        {
+            {
+                std::lock_guard<std::mutex> guard{ m_mutex };
+
+                auto found = take_waiter(fd, id);
+                if (!found)
+                    return;
+
+                m_canceled.emplace_back(std::move(*found));
+            }
+
+            wake();
+        }
+
+        //
+        // Removes the waiter on fd, as long as it's the one with the given id if there is one.
+        // Must be called with m_mutex held.
+        //
+        std::optional<waiter> take_waiter(int fd, std::optional<uint64_t> id)
+        {
+            auto itr = m_waiters.find(fd);
+            if (itr == m_waiters.end() || (id.has_value() && itr->second.id != *id))
+                return std::nullopt;
+
+            std::optional<waiter> found{ std::move(itr->second) };
+            m_waiters.erase(itr);
+
+            epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+
+            return found;
+        }
+
+        void close_fds()
+        {
+            if (m_wakeup != -1)
+            {
+                close(m_wakeup);
+            }
+
+            if (m_epoll != -1)
+            {
+                close(m_epoll);
+            }
+        }
+
+        int m_epoll;
+        int m_wakeup;
+        std::atomic<bool> m_signaled{ false };
+
+        std::mutex m_mutex;
+        std::vector<callback_t> m_queue;
+        std::unordered_map<int, waiter> m_waiters;
+        uint64_t m_nextWaiter = 0;
+
+        // cancelled waiters whose tasks are left for the loop thread to complete
+        std::vector<waiter> m_canceled;
+
+        std::vector<callback_t> m_workload;
+        affinity m_affinity;
+    };
+}
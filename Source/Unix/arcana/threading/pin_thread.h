@@ -0,0 +1,67 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#pragma once
+
+#include <gsl/gsl>
+
+#include <initializer_list>
+#include <pthread.h>
+#include <sched.h>
+#include <system_error>
+#include <vector>
+
+namespace arcana
+{
+    //
+    // Restricts the calling thread to the given processors, so that
+    // the scheduler stops migrating it away from its caches.
+    //
+    inline std::error_code pin_current_thread(gsl::span<const size_t> cpus)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+
+        for (size_t cpu : cpus)
+        {
+            if (cpu >= CPU_SETSIZE)
+            {
+                return std::make_error_code(std::errc::invalid_argument);
+            }
+
+            CPU_SET(cpu, &set);
+        }
+
+        const int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        return std::error_code{ result, std::system_category() };
+    }
+
+    inline std::error_code pin_current_thread(std::initializer_list<size_t> cpus)
+    {
+        return pin_current_thread(gsl::span<const size_t>{ cpus.begin(), cpus.size() });
+    }
+
+    //
+    // Returns the processors the calling thread is allowed to run on.
+    //
+    inline std::vector<size_t> current_thread_cpus()
+    {
+        std::vector<size_t> cpus;
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0)
+        {
+            for (size_t cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if (CPU_ISSET(cpu, &set))
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+
+        return cpus;
+    }
+}
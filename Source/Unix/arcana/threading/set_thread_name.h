@@ -0,0 +1,25 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#pragma once
+
+#include <gsl/gsl>
+
+#include <cstring>
+#include <pthread.h>
+
+namespace arcana
+{
+    //
+    // Names the calling thread. Linux limits thread names to 15 characters,
+    // longer names get truncated.
+    //
+    inline void set_thread_name(gsl::czstring threadName)
+    {
+        char name[16]{};
+        std::memcpy(name, threadName, strnlen(threadName, sizeof(name) - 1));
+
+        pthread_setname_np(pthread_self(), name);
+    }
+}
@@ -2,17 +2,194 @@
 // Copyright (C) Microsoft Corporation. All rights reserved.
 //
 
+//
+// Linux trace_region implementation writing Chrome trace event JSON.
+//
+// Begin and end events are recorded into a lock-free ring buffer owned by the thread
+// that records them, timestamped with the monotonic clock. Regions are written out as
+// async events paired by cookie, which keeps them intact when a trace_region is moved
+// to another thread (e.g. when an RAII trace_region is captured into an async
+// continuation). When a thread's ring buffer is full, new events are dropped and
+// counted instead of blocking the thread.
+//
+// Nothing is written anywhere until trace_region::flush is called, which drains every
+// thread's buffer into a complete trace document:
+//
+//   arcana::trace_region::enable();
+//   // ... run the workload ...
+//   arcana::trace_region::flush("trace.json");
+//
+// Then open the trace file at https://ui.perfetto.dev or chrome://tracing.
+//
+// Debug log output (at trace_level::log) goes to stderr.
+//
+
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
 namespace arcana
 {
+    namespace detail
+    {
+        struct trace_event
+        {
+            uint64_t timestamp;
+            int32_t cookie;
+            bool begin;
+            char name[51];
+        };
+
+        //
+        // Single producer, single consumer ring of trace events. The producer is the
+        // thread that owns the ring, the consumer is whoever flushes the trace.
+        //
+        class trace_event_ring
+        {
+        public:
+            static constexpr size_t capacity = 4096;
+
+            explicit trace_event_ring(uint64_t threadId)
+                : thread_id{ threadId }
+                , m_events{ std::make_unique<trace_event[]>(capacity) }
+            {}
+
+            void push(uint64_t timestamp, int32_t cookie, const char* name)
+            {
+                const size_t tail = m_tail.load(std::memory_order_relaxed);
+                if (tail - m_head.load(std::memory_order_acquire) == capacity)
+                {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+
+                trace_event& event = m_events[tail % capacity];
+                event.timestamp = timestamp;
+                event.cookie = cookie;
+                event.begin = name != nullptr;
+                if (name != nullptr)
+                {
+                    std::strncpy(event.name, name, sizeof(event.name) - 1);
+                    event.name[sizeof(event.name) - 1] = '\0';
+                }
+
+                m_tail.store(tail + 1, std::memory_order_release);
+            }
+
+            template<typename CallableT>
+            void drain(CallableT&& callable)
+            {
+                size_t head = m_head.load(std::memory_order_relaxed);
+                const size_t tail = m_tail.load(std::memory_order_acquire);
+
+                for (; head != tail; ++head)
+                {
+                    callable(m_events[head % capacity]);
+                }
+
+                m_head.store(head, std::memory_order_release);
+            }
+
+            const uint64_t thread_id;
+            std::atomic<bool> retired{ false };
+            std::atomic<size_t> dropped{ 0 };
+
+        private:
+            std::unique_ptr<trace_event[]> m_events;
+            alignas(64) std::atomic<size_t> m_head{ 0 };
+            alignas(64) std::atomic<size_t> m_tail{ 0 };
+        };
+
+        struct trace_registry
+        {
+            std::mutex mutex;
+            std::vector<std::shared_ptr<trace_event_ring>> rings;
+            size_t dropped = 0;
+
+            static trace_registry& get()
+            {
+                static trace_registry registry;
+                return registry;
+            }
+        };
+
+        inline trace_event_ring& current_trace_ring()
+        {
+            // The registry keeps the ring alive after its thread exits
+            // so that its last events still make it into the next flush.
+            thread_local struct ring_owner
+            {
+                ring_owner()
+                    : ring{ std::make_shared<trace_event_ring>(static_cast<uint64_t>(syscall(SYS_gettid))) }
+                {
+                    auto& registry = trace_registry::get();
+                    std::lock_guard<std::mutex> guard{ registry.mutex };
+                    registry.rings.push_back(ring);
+                }
+
+                ~ring_owner()
+                {
+                    ring->retired.store(true, std::memory_order_release);
+                }
+
+                std::shared_ptr<trace_event_ring> ring;
+            } owner;
+
+            return *owner.ring;
+        }
+
+        inline uint64_t trace_timestamp()
+        {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+        inline void write_json_string(std::ostream& output, const char* text)
+        {
+            output << '"';
+            for (; *text != '\0'; ++text)
+            {
+                const char c = *text;
+                if (c == '"' || c == '\\')
+                {
+                    output << '\\' << c;
+                }
+                else if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    output << escaped;
+                }
+                else
+                {
+                    output << c;
+                }
+            }
+            output << '"';
+        }
+    }
+
     enum class trace_level
     {
         mark,
         log,
     };
 
-    // TODO
     class trace_region final
     {
     public:
@@ -20,24 +197,163 @@ namespace arcana
         trace_region(const trace_region&) = delete;
         trace_region& operator=(const trace_region&) = delete;
 
-        trace_region(const char*)
+        trace_region(const char* name) :
+            m_cookie{s_enabled.load(std::memory_order_relaxed) ? begin(name) : 0}
         {
         }
 
-        trace_region(trace_region&&) = default;
+        // Move constructor transfers ownership; the moved-from region becomes inactive
+        // (cookie set to 0) so its destructor won't emit a spurious end event.
+        trace_region(trace_region&& other) :
+            m_cookie{other.m_cookie}
+        {
+            other.m_cookie = 0;
+        }
 
         ~trace_region()
         {
+            if (m_cookie != 0)
+            {
+                end(m_cookie, "");
+            }
         }
 
-        trace_region& operator=(trace_region&&) = default;
+        trace_region& operator=(trace_region&& other)
+        {
+            if (this == &other)
+            {
+                return *this;
+            }
+
+            if (m_cookie != 0)
+            {
+                end(m_cookie, " (move)");
+            }
+
+            m_cookie = other.m_cookie;
+            other.m_cookie = 0;
 
-        static void enable(trace_level = trace_level::mark)
+            return *this;
+        }
+
+        static void enable(trace_level level = trace_level::mark)
         {
+            if (s_enabled)
+            {
+                return;
+            }
+
+            s_logEnabled = level == trace_level::log;
+            s_enabled = true;
         }
 
         static void disable()
         {
+            if (!s_enabled)
+            {
+                return;
+            }
+
+            s_enabled = false;
+            s_logEnabled = false;
+        }
+
+        //
+        // Writes every event recorded since the last flush as a Chrome trace event
+        // JSON document. Regions that are still open show up unterminated.
+        //
+        static void flush(std::ostream& output)
+        {
+            auto& registry = detail::trace_registry::get();
+            std::lock_guard<std::mutex> guard{ registry.mutex };
+
+            const int pid = static_cast<int>(getpid());
+            bool first = true;
+
+            output << "{\"traceEvents\":[";
+            for (auto& ring : registry.rings)
+            {
+                // read the flag before draining, a retired ring doesn't get new events
+                const bool retired = ring->retired.load(std::memory_order_acquire);
+
+                ring->drain([&](const detail::trace_event& event) {
+                    output << (first ? "\n" : ",\n");
+                    first = false;
+
+                    output << "{\"ph\":\"" << (event.begin ? 'b' : 'e') << "\",\"cat\":\"arcana\",\"id\":" << event.cookie
+                           << ",\"pid\":" << pid << ",\"tid\":" << ring->thread_id
+                           << ",\"ts\":" << event.timestamp / 1000 << '.' << std::to_string(1000 + event.timestamp % 1000).substr(1);
+
+                    if (event.begin)
+                    {
+                        output << ",\"name\":";
+                        detail::write_json_string(output, event.name);
+                    }
+
+                    output << '}';
+                });
+
+                registry.dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+
+                if (retired)
+                {
+                    ring.reset();
+                }
+            }
+
+            registry.rings.erase(std::remove(registry.rings.begin(), registry.rings.end(), nullptr), registry.rings.end());
+
+            output << "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped_events\":\"" << std::exchange(registry.dropped, 0) << "\"}}\n";
+        }
+
+        static std::error_code flush(const std::string& path)
+        {
+            std::ofstream output{ path, std::ios::out | std::ios::trunc };
+            if (!output)
+            {
+                return std::make_error_code(std::errc::io_error);
+            }
+
+            flush(output);
+            output.flush();
+
+            return output ? std::error_code{} : std::make_error_code(std::errc::io_error);
         }
+
+    private:
+        static int32_t begin(const char* name)
+        {
+            int32_t cookie = s_nextCookie.fetch_add(1, std::memory_order_relaxed);
+            if (cookie == 0)
+            {
+                cookie = s_nextCookie.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            if (s_logEnabled)
+            {
+                std::fprintf(stderr, "[trace_region] BEGIN %s (cookie=%d)\n", name, cookie);
+            }
+
+            detail::current_trace_ring().push(detail::trace_timestamp(), cookie, name);
+            return cookie;
+        }
+
+        static void end(int32_t cookie, const char* reason)
+        {
+            if (s_logEnabled)
+            {
+                std::fprintf(stderr, "[trace_region] END%s (cookie=%d)\n", reason, cookie);
+            }
+
+            detail::current_trace_ring().push(detail::trace_timestamp(), cookie, nullptr);
+        }
+
+        static inline std::atomic<bool> s_enabled{false};
+        static inline std::atomic<bool> s_logEnabled{false};
+        static inline std::atomic<int32_t> s_nextCookie{1};
+
+        // Cookie pairs the begin and end events of this region, which may be recorded
+        // on different threads. A cookie of 0 means the region is inactive.
+        int32_t m_cookie;
     };
 }